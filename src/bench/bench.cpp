@@ -0,0 +1,544 @@
+// Ray tracing with a cone tree
+// Copyright © 2022 otreblan
+//
+// cone-tree is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// cone-tree is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with cone-tree.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <cmath>
+#include <csignal>
+#include <cstdlib>
+#include <getopt.h>
+#include <linux/perf_event.h>
+#include <random>
+#include <string>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+#include <fmt/core.h>
+#include <glm/geometric.hpp>
+#include <glm/gtc/random.hpp>
+
+#include "../rtx/camera.hpp"
+#include "../rtx/ray_sort.hpp"
+#include "../scene/scene_factory.hpp"
+#include "../scene/visit_scene.hpp"
+#include "../stats.hpp"
+#include "../timer.hpp"
+#include "scene_gen.hpp"
+
+// Every case runs in its own process, so the peak RSS reported by the kernel belongs to that case
+// alone and a case that hangs or crashes doesn't take the whole run with it.
+
+struct bench_options
+{
+    std::vector<std::string> generators{std::begin(scene_generators), std::end(scene_generators)};
+    std::vector<std::string> backends{std::begin(scene_backends), std::end(scene_backends)};
+    int min_size = 1000;
+    int max_size = 100000;
+    int width = 320;
+    unsigned seed = 1;
+    unsigned timeout = 120;
+    bool json = false;
+    scene_options scene;
+};
+
+struct bench_case
+{
+    std::string generator;
+    int size;
+    std::string backend;
+};
+
+// Sent through a pipe from the child, keep it trivially copyable
+struct bench_result
+{
+    double build_s = 0;
+    double primary_mrays = 0;
+    double diffuse_mrays = 0;
+    double diffuse_sorted_mrays = 0;
+    double shadow_mrays = 0;
+    // Per ray, negative when the kernel has no hardware counters for us
+    double diffuse_misses = -1;
+    double diffuse_sorted_misses = -1;
+    // Per insert or remove after freeze, and per update of an inserted object in place, negative
+    // when the backend can only rebuild
+    double edit_us = -1;
+    double update_us = -1;
+    long primary_hits = 0;
+
+    float sah_cost = 0;
+    int nodes = 0;
+    int leaves = 0;
+    std::uint64_t references = 0;
+    traversal_stats traversal;
+};
+
+struct bench_row
+{
+    const char* status;
+    bench_result result;
+    long peak_rss_kb;
+};
+
+static std::vector<std::string> split_list(const char* arg)
+{
+    std::vector<std::string> items;
+    std::string_view list(arg);
+    while (!list.empty())
+    {
+        auto comma = list.find(',');
+        items.emplace_back(list.substr(0, comma));
+        list = comma == list.npos ? std::string_view() : list.substr(comma + 1);
+    }
+    return items;
+}
+
+static double mrays(std::size_t count, double seconds)
+{
+    return seconds > 0 ? (double)count / seconds / 1e6 : 0;
+}
+
+// Last level cache misses of this process while running, stop() is -1 without perf events
+class cache_miss_counter
+{
+public:
+    cache_miss_counter()
+    {
+        perf_event_attr attr{};
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.size = sizeof(attr);
+        attr.config = PERF_COUNT_HW_CACHE_MISSES;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        fd = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    }
+
+    ~cache_miss_counter()
+    {
+        if (fd >= 0)
+            close(fd);
+    }
+
+    cache_miss_counter(const cache_miss_counter&) = delete;
+    cache_miss_counter& operator=(const cache_miss_counter&) = delete;
+
+    void start()
+    {
+        if (fd < 0)
+            return;
+        ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+
+    long long stop()
+    {
+        long long count;
+        if (fd < 0)
+            return -1;
+        ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+        if (read(fd, &count, sizeof(count)) != sizeof(count))
+            return -1;
+        return count;
+    }
+
+private:
+    int fd;
+};
+
+static double per_ray_misses(long long misses, std::size_t rays)
+{
+    return misses < 0 || rays == 0 ? -1 : (double)misses / (double)rays;
+}
+
+static bench_result run_case(const bench_case& c, const bench_options& opts)
+{
+    bench_result result;
+
+    auto world = make_scene(c.backend, opts.scene);
+    for (auto& object : generate_scene(c.generator, c.size, opts.seed))
+        world->add(std::move(object));
+    world->materials.push_back(lambertian{glm::vec3(0.5f)});
+
+    Timer timer;
+    world->freeze();
+    result.build_s = timer.elapsed();
+
+    auto stats = world->stats();
+    result.sah_cost = stats.sah_cost;
+    result.nodes = stats.nodes;
+    result.leaves = stats.leaves;
+    result.references = stats.references;
+
+    std::mt19937 gen(opts.seed);
+    std::uniform_real_distribution<float> jitter(0.f, 1.f);
+
+    const float aspect_ratio = 16.f / 9.f;
+    const int width = opts.width;
+    const int height = std::max(1, (int)(width / aspect_ratio));
+    const camera cam = camera::pointing(glm::vec3(0.f, 1.5f, 4.f), glm::vec3(0.f),
+                                        2 * glm::atan(1.f), aspect_ratio, 1.f);
+    const glm::vec3 light(2.f, 4.f, 2.f);
+
+    std::vector<ray> rays;
+    rays.reserve(width * height);
+    for (int j = 0; j < height; ++j)
+    {
+        for (int i = 0; i < width; ++i)
+        {
+            float u = (i + jitter(gen)) / width;
+            float v = (j + jitter(gen)) / height;
+            rays.push_back(cam.get_ray(u, v));
+        }
+    }
+
+    // Primary rays. Every loop goes through the backend's own class, like renders do.
+    reset_traversal_stats();
+    std::vector<hit_record> hits(rays.size());
+    std::vector<char> hit_mask(rays.size());
+    timer.reset();
+    visit_scene(*world,
+                [&](const auto& backend)
+                {
+                    for (std::size_t i = 0; i < rays.size(); ++i)
+                        hit_mask[i] = backend.hit(rays[i], 0.001f, HUGE_VALF, hits[i]);
+                });
+    result.primary_mrays = mrays(rays.size(), timer.elapsed());
+
+    std::vector<std::size_t> hit_idx;
+    for (std::size_t i = 0; i < rays.size(); ++i)
+        if (hit_mask[i])
+            hit_idx.push_back(i);
+    result.primary_hits = hit_idx.size();
+
+    // Diffuse bounces off the primary hits
+    std::normal_distribution<float> normal(0.f, 1.f);
+    std::vector<ray> secondary;
+    secondary.reserve(hit_idx.size());
+    for (auto i : hit_idx)
+    {
+        float x = normal(gen);
+        float y = normal(gen);
+        float z = normal(gen);
+        glm::vec3 dir = hits[i].normal + glm::normalize(glm::vec3(x, y, z));
+        secondary.emplace_back(hits[i].p, dir);
+    }
+
+    cache_miss_counter misses;
+    misses.start();
+    timer.reset();
+    visit_scene(*world,
+                [&](const auto& backend)
+                {
+                    for (const auto& r : secondary)
+                    {
+                        hit_record rec;
+                        backend.hit(r, 0.001f, HUGE_VALF, rec);
+                    }
+                });
+    result.diffuse_mrays = mrays(secondary.size(), timer.elapsed());
+    result.diffuse_misses = per_ray_misses(misses.stop(), secondary.size());
+
+    // The same rays sorted by origin and direction, the sort counts against the throughput
+    std::vector<glm::vec3> origins;
+    std::vector<glm::vec3> directions;
+    for (const auto& r : secondary)
+    {
+        origins.push_back(r.origin);
+        directions.push_back(r.direction);
+    }
+
+    misses.start();
+    timer.reset();
+    std::vector<std::uint32_t> order;
+    sort_rays(origins, directions, order);
+    visit_scene(*world,
+                [&](const auto& backend)
+                {
+                    for (auto k : order)
+                    {
+                        hit_record rec;
+                        backend.hit(ray(origins[k], directions[k]), 0.001f, HUGE_VALF, rec);
+                    }
+                });
+    result.diffuse_sorted_mrays = mrays(secondary.size(), timer.elapsed());
+    result.diffuse_sorted_misses = per_ray_misses(misses.stop(), secondary.size());
+
+    // Shadow rays towards a point light, the direction isn't normalized so t ends at the light
+    secondary.clear();
+    for (auto i : hit_idx)
+        secondary.emplace_back(hits[i].p, light - hits[i].p);
+
+    timer.reset();
+    visit_scene(*world,
+                [&](const auto& backend)
+                {
+                    for (const auto& r : secondary)
+                    {
+                        hit_record rec;
+                        backend.hit(r, 0.001f, 1.f, rec);
+                    }
+                });
+    result.shadow_mrays = mrays(secondary.size(), timer.elapsed());
+    result.traversal = collect_traversal_stats();
+
+    // Last, the edits change the tree: 1% more objects inserted, each replaced by another one
+    // like a moving object would be, and then removed again
+    auto extra = generate_scene(c.generator, std::max(1, c.size / 100), opts.seed + 1);
+    auto moved = generate_scene(c.generator, (int)extra.size(), opts.seed + 2);
+    std::vector<std::size_t> ids;
+    try
+    {
+        timer.reset();
+        for (auto& object : extra)
+            ids.push_back(world->insert(std::move(object)));
+        double edit_s = timer.elapsed();
+
+        timer.reset();
+        for (std::size_t k = 0; k < ids.size(); ++k)
+            world->update(ids[k], std::move(moved[k]));
+        result.update_us = 1e6 * timer.elapsed() / ids.size();
+
+        timer.reset();
+        for (auto id : ids)
+            world->remove(id);
+        result.edit_us = 1e6 * (edit_s + timer.elapsed()) / (2 * ids.size());
+    }
+    catch (const std::runtime_error&)
+    {
+    }
+
+    return result;
+}
+
+static bench_row run_forked(const bench_case& c, const bench_options& opts)
+{
+    int fds[2];
+    if (pipe(fds) != 0)
+        throw std::runtime_error("Failed to create pipe");
+
+    pid_t pid = fork();
+    if (pid < 0)
+        throw std::runtime_error("Failed to fork");
+
+    if (pid == 0)
+    {
+        close(fds[0]);
+        alarm(opts.timeout);
+        bench_result result = run_case(c, opts);
+        bool ok = write(fds[1], &result, sizeof(result)) == sizeof(result);
+        _exit(ok ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+
+    close(fds[1]);
+
+    int status;
+    rusage usage{};
+    wait4(pid, &status, 0, &usage);
+
+    bench_row row{"ok", {}, usage.ru_maxrss};
+    if (WIFSIGNALED(status))
+        row.status = WTERMSIG(status) == SIGALRM ? "timeout" : "crashed";
+    else if (WEXITSTATUS(status) != EXIT_SUCCESS ||
+             read(fds[0], &row.result, sizeof(row.result)) != sizeof(row.result))
+        row.status = "failed";
+
+    close(fds[0]);
+    return row;
+}
+
+// Traversal counters averaged over every traced ray, empty unless built with CONE_TREE_STATS
+static std::string per_ray(std::uint64_t counter, const traversal_stats& stats, const char* none)
+{
+    if (!traversal_stats_enabled || stats.rays == 0)
+        return none;
+    return fmt::format("{:.3f}", (double)counter / (double)stats.rays);
+}
+
+// Negative values mean there is nothing to report
+static std::string optional(double value, const char* none)
+{
+    return value < 0 ? none : fmt::format("{:.3f}", value);
+}
+
+static void print_row(const bench_case& c, const bench_row& row, bool json, bool first)
+{
+    const auto& r = row.result;
+    const auto& t = r.traversal;
+    const char* none = json ? "null" : "";
+    if (json)
+    {
+        fmt::print("{}\n    {{\"generator\": \"{}\", \"size\": {}, \"backend\": \"{}\", "
+                   "\"status\": \"{}\", \"build_s\": {:.6f}, \"peak_rss_kb\": {}, "
+                   "\"primary_mrays\": {:.3f}, \"diffuse_mrays\": {:.3f}, "
+                   "\"diffuse_sorted_mrays\": {:.3f}, \"shadow_mrays\": {:.3f}, "
+                   "\"diffuse_misses_per_ray\": {}, \"diffuse_sorted_misses_per_ray\": {}, "
+                   "\"edit_us\": {}, \"update_us\": {}, \"primary_hits\": {}, \"sah_cost\": {:.3f}, \"nodes\": {}, "
+                   "\"leaves\": {}, \"references\": {}, \"nodes_per_ray\": {}, \"leaves_per_ray\": {}, "
+                   "\"prims_per_ray\": {}, \"empty_leaves_per_ray\": {}}}",
+                   first ? "" : ",", c.generator, c.size, c.backend, row.status, r.build_s,
+                   row.peak_rss_kb, r.primary_mrays, r.diffuse_mrays, r.diffuse_sorted_mrays,
+                   r.shadow_mrays, optional(r.diffuse_misses, none),
+                   optional(r.diffuse_sorted_misses, none), optional(r.edit_us, none),
+                   optional(r.update_us, none), r.primary_hits, r.sah_cost, r.nodes, r.leaves, r.references,
+                   per_ray(t.nodes, t, none), per_ray(t.leaves, t, none),
+                   per_ray(t.primitives, t, none), per_ray(t.empty_leaves, t, none));
+    }
+    else
+    {
+        fmt::print("{},{},{},{},{},{:.6f},{},{:.3f},{:.3f},{:.3f},{:.3f},{},{},{},{},{},{:.3f},{},{},"
+                   "{},{},{},{},{}\n",
+                   CONE_TREE_VERSION, c.generator, c.size, c.backend, row.status, r.build_s,
+                   row.peak_rss_kb, r.primary_mrays, r.diffuse_mrays, r.diffuse_sorted_mrays,
+                   r.shadow_mrays, optional(r.diffuse_misses, none),
+                   optional(r.diffuse_sorted_misses, none), optional(r.edit_us, none),
+                   optional(r.update_us, none), r.primary_hits, r.sah_cost, r.nodes, r.leaves, r.references,
+                   per_ray(t.nodes, t, none), per_ray(t.leaves, t, none),
+                   per_ray(t.primitives, t, none), per_ray(t.empty_leaves, t, none));
+    }
+    std::fflush(stdout);
+}
+
+static void usage(const char* argv0)
+{
+    fmt::print(stderr,
+               "Usage: {} [OPTION]...\n"
+               "Build and traversal benchmarks over procedural scenes.\n\n"
+               "  -s, --scenes=LIST     comma separated generators (default: all)\n"
+               "  -b, --backends=LIST   comma separated scene backends (default: all)\n"
+               "  -m, --min-size=N      smallest scene, sizes grow by 10x (default: 1000)\n"
+               "  -M, --max-size=N      largest scene (default: 100000)\n"
+               "  -w, --width=N         primary rays per row, 16:9 frame (default: 320)\n"
+               "  -S, --seed=N          random seed for scenes and rays (default: 1)\n"
+               "  -t, --timeout=SECS    abort a case after this long (default: 120)\n"
+               "  -T, --treelet-rounds=N  optimize bvh and qbvh treelets N times (default: 0)\n"
+               "  -l, --layout=LAYOUT   bvh, kd6, ooc and split node order: build, dfs or veb\n"
+               "                        (default: build)\n"
+               "  -L, --lazy            bvh: split nodes when rays first reach them\n"
+               "  -j, --json            print JSON instead of CSV\n"
+               "  -h, --help            show this help\n\n"
+               "Generators: spheres, soup, plane, mixed\n"
+               "Backends: list, bvh, qbvh, kd6, ooc, split\n",
+               argv0);
+}
+
+int main(int argc, char* argv[])
+{
+    bench_options opts;
+
+    const option long_options[] = {
+        {"scenes", required_argument, nullptr, 's'},
+        {"backends", required_argument, nullptr, 'b'},
+        {"min-size", required_argument, nullptr, 'm'},
+        {"max-size", required_argument, nullptr, 'M'},
+        {"width", required_argument, nullptr, 'w'},
+        {"seed", required_argument, nullptr, 'S'},
+        {"timeout", required_argument, nullptr, 't'},
+        {"treelet-rounds", required_argument, nullptr, 'T'},
+        {"layout", required_argument, nullptr, 'l'},
+        {"lazy", no_argument, nullptr, 'L'},
+        {"json", no_argument, nullptr, 'j'},
+        {"help", no_argument, nullptr, 'h'},
+        {nullptr, 0, nullptr, 0},
+    };
+
+    int c;
+    while ((c = getopt_long(argc, argv, "s:b:m:M:w:S:t:T:l:Ljh", long_options, nullptr)) != -1)
+    {
+        switch (c)
+        {
+            case 's':
+                opts.generators = split_list(optarg);
+                break;
+            case 'b':
+                opts.backends = split_list(optarg);
+                break;
+            case 'm':
+                opts.min_size = std::stoi(optarg);
+                break;
+            case 'M':
+                opts.max_size = std::stoi(optarg);
+                break;
+            case 'w':
+                opts.width = std::stoi(optarg);
+                break;
+            case 'S':
+                opts.seed = std::stoul(optarg);
+                break;
+            case 't':
+                opts.timeout = std::stoul(optarg);
+                break;
+            case 'T':
+                opts.scene.treelet_rounds = std::stoi(optarg);
+                break;
+            case 'l':
+                opts.scene.layout = parse_node_layout(optarg);
+                break;
+            case 'L':
+                opts.scene.lazy = true;
+                break;
+            case 'j':
+                opts.json = true;
+                break;
+            case 'h':
+                usage(argv[0]);
+                return EXIT_SUCCESS;
+            default:
+                usage(argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+
+    if (opts.min_size < 1 || opts.width < 1)
+    {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    // Catch typos before forking anything
+    for (const auto& backend : opts.backends)
+        make_scene(backend);
+    for (const auto& generator : opts.generators)
+        generate_scene(generator, 0, opts.seed);
+
+    if (opts.json)
+        fmt::print("{{\n  \"version\": \"{}\",\n  \"results\": [", CONE_TREE_VERSION);
+    else
+        fmt::print("version,generator,size,backend,status,build_s,peak_rss_kb,primary_mrays,"
+                   "diffuse_mrays,diffuse_sorted_mrays,shadow_mrays,diffuse_misses_per_ray,"
+                   "diffuse_sorted_misses_per_ray,edit_us,update_us,primary_hits,sah_cost,nodes,leaves,"
+                   "references,nodes_per_ray,leaves_per_ray,prims_per_ray,empty_leaves_per_ray\n");
+
+    bool first = true;
+    for (const auto& generator : opts.generators)
+    {
+        for (long size = opts.min_size; size <= opts.max_size; size *= 10)
+        {
+            for (const auto& backend : opts.backends)
+            {
+                bench_case c{generator, (int)size, backend};
+                print_row(c, run_forked(c, opts), opts.json, first);
+                first = false;
+            }
+        }
+    }
+
+    if (opts.json)
+        fmt::print("\n  ]\n}}\n");
+
+    return EXIT_SUCCESS;
+}
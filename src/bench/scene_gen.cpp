@@ -0,0 +1,121 @@
+// Ray tracing with a cone tree
+// Copyright © 2022 otreblan
+//
+// cone-tree is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// cone-tree is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with cone-tree.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "scene_gen.hpp"
+
+#include <cmath>
+#include <random>
+#include <stdexcept>
+#include <string>
+
+#include "../object/sphere.hpp"
+#include "../object/triangle.hpp"
+
+namespace
+{
+
+using engine = std::mt19937;
+
+glm::vec3 random_point(engine& gen, float extent)
+{
+    std::uniform_real_distribution<float> dist(-extent, extent);
+    float x = dist(gen);
+    float y = dist(gen);
+    float z = dist(gen);
+    return {x, y, z};
+}
+
+// Average spacing between n objects spread over the [-1, 1]³ box
+float spacing(int n) { return 2.f / std::cbrt((float)std::max(n, 1)); }
+
+void random_spheres(ObjectList& objects, int n, engine& gen,
+                    material_id mat)
+{
+    const float radius = 0.25f * spacing(n);
+    for (int i = 0; i < n; ++i)
+        objects.push_back(std::make_unique<sphere>(random_point(gen, 1.f), radius, mat));
+}
+
+void triangle_soup(ObjectList& objects, int n, float size, engine& gen,
+                   material_id mat)
+{
+    for (int i = 0; i < n; ++i)
+    {
+        auto center = random_point(gen, 1.f);
+        auto v0 = center + random_point(gen, size);
+        auto v1 = center + random_point(gen, size);
+        auto v2 = center + random_point(gen, size);
+        objects.push_back(std::make_unique<triangle>(v0, v1, v2, mat));
+    }
+}
+
+void tessellated_plane(ObjectList& objects, int n, material_id mat)
+{
+    const int cells = std::max(1, (int)std::ceil(std::sqrt(n / 2.f)));
+    const float step = 4.f / cells;
+    for (int z = 0; z < cells; ++z)
+    {
+        for (int x = 0; x < cells; ++x)
+        {
+            glm::vec3 v00(-2.f + x * step, -1.f, -2.f + z * step);
+            glm::vec3 v10 = v00 + glm::vec3(step, 0.f, 0.f);
+            glm::vec3 v01 = v00 + glm::vec3(0.f, 0.f, step);
+            glm::vec3 v11 = v00 + glm::vec3(step, 0.f, step);
+
+            if ((int)objects.size() < n)
+                objects.push_back(std::make_unique<triangle>(v00, v10, v01, mat));
+            if ((int)objects.size() < n)
+                objects.push_back(std::make_unique<triangle>(v10, v11, v01, mat));
+        }
+    }
+}
+
+void large_and_tiny(ObjectList& objects, int n, engine& gen, material_id mat)
+{
+    const int large = std::max(1, n / 100);
+    for (int i = 0; i < large; ++i)
+    {
+        auto v0 = random_point(gen, 2.f);
+        auto v1 = random_point(gen, 2.f);
+        auto v2 = random_point(gen, 2.f);
+        objects.push_back(std::make_unique<triangle>(v0, v1, v2, mat));
+    }
+    triangle_soup(objects, n - large, 0.1f * spacing(n), gen, mat);
+}
+
+} // namespace
+
+ObjectList generate_scene(std::string_view generator, int count, unsigned seed)
+{
+    engine gen(seed);
+    const material_id mat = 0;
+
+    ObjectList objects;
+    objects.reserve(count);
+
+    if (generator == "spheres")
+        random_spheres(objects, count, gen, mat);
+    else if (generator == "soup")
+        triangle_soup(objects, count, 0.5f * spacing(count), gen, mat);
+    else if (generator == "plane")
+        tessellated_plane(objects, count, mat);
+    else if (generator == "mixed")
+        large_and_tiny(objects, count, gen, mat);
+    else
+        throw std::runtime_error("Unknown scene generator: \"" + std::string(generator) + "\"");
+
+    return objects;
+}
@@ -0,0 +1,36 @@
+// Ray tracing with a cone tree
+// Copyright © 2022 otreblan
+//
+// cone-tree is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// cone-tree is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with cone-tree.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <memory>
+#include <string_view>
+#include <vector>
+
+#include "../object/hittable.hpp"
+
+using ObjectList = std::vector<std::unique_ptr<hittable>>;
+
+// Procedural scenes, all of them fit roughly in the [-2, 2]³ box
+//
+// spheres: uniformly scattered spheres of similar size.
+// soup:    small randomly oriented triangles.
+// plane:   a flat tessellated ground plane.
+// mixed:   a few huge triangles spanning the scene among lots of tiny ones.
+constexpr std::string_view scene_generators[] = {"spheres", "soup", "plane", "mixed"};
+
+// Same generator, count and seed always give the same scene. Every object uses material 0.
+ObjectList generate_scene(std::string_view generator, int count, unsigned seed);
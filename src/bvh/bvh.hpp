@@ -1,250 +1,432 @@
-// Ray tracing with a cone tree
-// Copyright © 2022 otreblan
-//
-// cone-tree is free software: you can redistribute it and/or modify
-// it under the terms of the GNU General Public License as published by
-// the Free Software Foundation, either version 3 of the License, or
-// (at your option) any later version.
-//
-// cone-tree is distributed in the hope that it will be useful,
-// but WITHOUT ANY WARRANTY; without even the implied warranty of
-// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
-// GNU General Public License for more details.
-//
-// You should have received a copy of the GNU General Public License
-// along with cone-tree.  If not, see <http://www.gnu.org/licenses/>.
-
-#pragma once
-
-#include "../math/aabb.hpp"
-#include "../object/hittable.hpp"
-#include <vector>
-
-struct BVHNode
-{
-    AABB aabb;
-    int leftFirst = 0;
-    int triCount = 0;
-
-    [[nodiscard]] bool isLeaf() const noexcept { return triCount > 0; }
-};
-
-struct BVHBestAxisResult
-{
-    int axis;
-    float pos;
-    float cost;
-};
-
-struct BVH
-{
-public:
-    std::vector<std::unique_ptr<hittable>> objects;
-
-private:
-    std::unique_ptr<BVHNode[]> bvhNode = nullptr;
-    std::unique_ptr<glm::vec3[]> centroid = nullptr;
-    std::unique_ptr<AABB[]> aabb = nullptr;
-    std::unique_ptr<int[]> triIdx = nullptr;
-    int nodesUsed = 1;
-
-public:
-    void add(std::unique_ptr<hittable>&& object) { objects.push_back(std::move(object)); }
-    void build() noexcept
-    {
-        auto n = (int)objects.size();
-        triIdx = std::make_unique<int[]>(n);
-        centroid = std::make_unique<glm::vec3[]>(n);
-        aabb = std::make_unique<AABB[]>(n);
-        bvhNode = std::make_unique<BVHNode[]>(n * 2);
-
-        for (int i = 0; i < n; i++)
-        {
-            triIdx[i] = i;
-        }
-
-        for (int i = 0; i < n; i++)
-        {
-            centroid[i] = objects[i]->centroid();
-            aabb[i] = objects[i]->bounding_box();
-        }
-
-        BVHNode& root = bvhNode[0];
-        root.leftFirst = 0, root.triCount = n;
-
-        update_node_bounds(0);
-        subdivide(0);
-    }
-    void clear() noexcept
-    {
-        bvhNode.reset();
-        centroid.reset();
-        aabb.reset();
-        triIdx.reset();
-        nodesUsed = 1;
-    }
-    bool hit(const ray& ray, float min_time, float max_time, hit_record& hit) const
-    {
-        const BVHNode *node = &bvhNode[0], *stack[64];
-        int stackPtr = 0;
-        bool hitSomething = false;
-
-        while (true)
-        {
-            if (node->isLeaf())
-            {
-                for (int i = 0; i < node->triCount; i++)
-                {
-                    hit_record temp_hit;
-                    const auto object_idx = triIdx[node->leftFirst + i];
-                    const auto& object = objects[object_idx];
-                    if (object && object->hit(ray, min_time, max_time, temp_hit))
-                    {
-                        hit = temp_hit;
-                        hitSomething = true;
-                        max_time = temp_hit.t;
-                    }
-                }
-                if (stackPtr == 0)
-                    break;
-                else
-                    node = stack[--stackPtr];
-                continue;
-            }
-            const BVHNode* child1 = &bvhNode[node->leftFirst];
-            const BVHNode* child2 = &bvhNode[node->leftFirst + 1];
-            float dist1 = child1->aabb.intersection_time(ray, min_time, hit.t).first;
-            float dist2 = child2->aabb.intersection_time(ray, min_time, hit.t).first;
-            if (dist1 > dist2)
-            {
-                std::swap(dist1, dist2);
-                std::swap(child1, child2);
-            }
-            if (dist1 == 1e30f)
-            {
-                if (stackPtr == 0)
-                    break;
-                else
-                    node = stack[--stackPtr];
-            }
-            else
-            {
-                node = child1;
-                if (dist2 != 1e30f)
-                    stack[stackPtr++] = child2;
-            }
-        }
-        return hitSomething;
-    }
-
-private:
-    void update_node_bounds(int nodeIdx) noexcept
-    {
-        BVHNode& node = bvhNode[nodeIdx];
-        node.aabb.min = glm::vec3(1e30f);
-        node.aabb.max = glm::vec3(-1e30f);
-        for (int first = node.leftFirst, i = 0; i < node.triCount; i++)
-        {
-            int leafTriIdx = triIdx[first + i];
-            const auto& leafTri = objects[leafTriIdx];
-            const AABB& leafTriBounds = aabb[leafTriIdx];
-
-            node.aabb.min = glm::min(node.aabb.min, leafTriBounds.min);
-            node.aabb.max = glm::max(node.aabb.max, leafTriBounds.max);
-        }
-    }
-    void subdivide(int nodeIdx) noexcept
-    {
-        // terminate recursion
-        BVHNode& node = bvhNode[nodeIdx];
-        BVHBestAxisResult best = find_best_axis(node);
-
-        float parentArea = node.aabb.area();
-        float parentCost = (float)node.triCount * parentArea;
-        if (best.cost >= parentCost)
-            return;
-
-        int splitIdx = split(node, best);
-
-        int leftCount = splitIdx - node.leftFirst;
-        if (leftCount == 0 || leftCount == node.triCount)
-            return;
-        // create child nodes
-        int leftChildIdx = nodesUsed++;
-        int rightChildIdx = nodesUsed++;
-        bvhNode[leftChildIdx].leftFirst = node.leftFirst;
-        bvhNode[leftChildIdx].triCount = leftCount;
-        bvhNode[rightChildIdx].leftFirst = splitIdx;
-        bvhNode[rightChildIdx].triCount = node.triCount - leftCount;
-        node.leftFirst = leftChildIdx;
-        node.triCount = 0;
-
-        update_node_bounds(leftChildIdx);
-        update_node_bounds(rightChildIdx);
-        // recurse
-        subdivide(leftChildIdx);
-        subdivide(rightChildIdx);
-    }
-    int split(const BVHNode& node, const BVHBestAxisResult& best) noexcept
-    {
-        int i = node.leftFirst;
-        int j = i + node.triCount - 1;
-        while (i <= j)
-        {
-            if (centroid[triIdx[i]][best.axis] < best.pos)
-            {
-                i++;
-            }
-            else
-            {
-                std::swap(triIdx[i], triIdx[j--]);
-            }
-        }
-        return i;
-    }
-    [[nodiscard]] auto find_best_axis(const BVHNode& node) const -> BVHBestAxisResult
-    {
-        BVHBestAxisResult best = {-1, 0, 1e30f};
-
-        for (int axis = 0; axis < 3; axis++)
-        {
-            for (int i = 0; i < node.triCount; i++)
-            {
-                float candidatePos = centroid[triIdx[node.leftFirst + i]][axis];
-                float cost = evaluate_sah(node, axis, candidatePos);
-                if (cost < best.cost)
-                {
-                    best.pos = candidatePos, best.axis = axis, best.cost = cost;
-                }
-            }
-        }
-        return best;
-    }
-    [[nodiscard]] float evaluate_sah(const BVHNode& node, int axis, float pos) const noexcept
-    {
-        // determine triangle counts and bounds for this split candidate
-        AABB leftBox, rightBox;
-        int leftCount = 0, rightCount = 0;
-        for (int i = 0; i < node.triCount; i++)
-        {
-            auto tri_idx = triIdx[node.leftFirst + i];
-            const auto& triangle = objects[tri_idx];
-            const AABB& triBounds = aabb[tri_idx];
-            if (centroid[tri_idx][axis] < pos)
-            {
-                leftBox.min = glm::min(leftBox.min, triBounds.min);
-                leftBox.max = glm::max(leftBox.max, triBounds.max);
-                leftCount++;
-            }
-            else
-            {
-                rightBox.min = glm::min(rightBox.min, triBounds.min);
-                rightBox.max = glm::max(rightBox.max, triBounds.max);
-                rightCount++;
-            }
-        }
-        float left_area = leftBox.area(), right_area = rightBox.area();
-        float cost = (float)leftCount * left_area + (float)rightCount * right_area;
-        return cost > 0 ? cost : 1e30f;
-    }
-};
+// Ray tracing with a cone tree
+// Copyright © 2022 otreblan
+//
+// cone-tree is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// cone-tree is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with cone-tree.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include "../layout.hpp"
+#include "../math/aabb.hpp"
+#include "../object/hittable.hpp"
+#include "../object/primitive_types.hpp"
+#include "../object/sphere_store.hpp"
+#include "../object/triangle.hpp"
+#include "../sah.hpp"
+#include "../stats.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+struct BVHNode
+{
+    AABB aabb;
+    int leftFirst = 0;
+    int triCount = 0;
+
+    [[nodiscard]] bool isLeaf() const noexcept { return triCount > 0; }
+};
+
+struct BVHBestAxisResult
+{
+    int axis;
+    float pos;
+    float cost;
+};
+
+struct BVH
+{
+public:
+    std::vector<std::unique_ptr<hittable>> objects;
+
+private:
+    friend struct QBVH;
+    friend class cluster_file;
+
+    std::vector<BVHNode> bvhNode;
+    std::vector<glm::vec3> centroid;
+    std::vector<AABB> aabb;
+    std::vector<int> triIdx;
+    int nodesUsed = 1;
+    sah_params sah;
+    sphere_store spheres; // In triIdx order
+    primitive_types types;
+
+    // Only filled once the built tree is edited, see update.cpp
+    std::vector<int> parent;    // Of every node, -1 for the root
+    std::vector<int> leafOf;    // Leaf holding every object, -1 once removed
+    std::vector<int> freePairs; // First node of every unused sibling pair
+    std::vector<int> freeSlots; // Unused entries of triIdx
+
+    // Only for lazy builds, see lazy.cpp
+    enum : std::uint8_t
+    {
+        pending,   // A leaf nobody has tried to split yet
+        splitting, // Some thread is splitting it
+        ready,     // Split, or a leaf for good
+    };
+    std::unique_ptr<std::atomic<std::uint8_t>[]> nodeState;
+    std::unique_ptr<std::atomic<int>> lazyNodesUsed;
+
+public:
+    void add(std::unique_ptr<hittable>&& object) { objects.push_back(std::move(object)); }
+    // A lazy build only bounds the root, every node is split the first time a ray reaches it
+    void build(const sah_params& params = {}, bool lazy = false) noexcept
+    {
+        sah = params;
+        auto n = (int)objects.size();
+        triIdx.assign(n, 0);
+        centroid.assign(n, {});
+        aabb.assign(n, {});
+        bvhNode.assign(std::max(n * 2, 2), {});
+        nodesUsed = 1;
+        dropEdits();
+
+        for (int i = 0; i < n; i++)
+        {
+            triIdx[i] = i;
+        }
+
+        for (int i = 0; i < n; i++)
+        {
+            centroid[i] = objects[i]->centroid();
+            aabb[i] = objects[i]->bounding_box();
+        }
+        types.clear();
+        types.add(objects);
+
+        BVHNode& root = bvhNode[0];
+        root.leftFirst = 0, root.triCount = n;
+
+        update_node_bounds(0);
+        nodeState.reset();
+        lazyNodesUsed.reset();
+        if (lazy)
+        {
+            nodeState = std::make_unique<std::atomic<std::uint8_t>[]>(bvhNode.size());
+            lazyNodesUsed = std::make_unique<std::atomic<int>>(nodesUsed);
+        }
+        else
+        {
+            subdivide(0);
+        }
+        spheres.build(objects, triIdx.data(), n);
+    }
+    // Rewrites small treelets of the built tree to lower its SAH cost, see treelet.cpp
+    void optimizeTreelets(int rounds);
+    // Edits of the built tree, see update.cpp. Objects keep the index they were added with and
+    // new ones are appended, the index of a removed object is never reused. update() replaces an
+    // object in its own leaf and refits the way up, so a moved object keeps its index.
+    int insert(std::unique_ptr<hittable>&& object);
+    void remove(int objectIdx);
+    void update(int objectIdx, std::unique_ptr<hittable>&& object);
+    // Moves the sibling pairs of the built tree to the given layout
+    void reorder(node_layout layout)
+    {
+        if (layout == node_layout::build || bvhNode.empty())
+            return;
+
+        std::vector<std::array<int, 2>> children(nodesUsed, {-1, -1});
+        std::vector<float> weight(nodesUsed);
+        for (int i = 0; i < nodesUsed; i++)
+        {
+            if (!bvhNode[i].isLeaf())
+                children[i] = {bvhNode[i].leftFirst, bvhNode[i].leftFirst + 1};
+            weight[i] = bvhNode[i].aabb.area();
+        }
+
+        std::vector<BVHNode> reordered(bvhNode.size());
+        std::vector<int> newIdx(nodesUsed);
+        reordered[0] = bvhNode[0];
+        int next = 1;
+        for (int nodeIdx : pair_order(layout, children, weight))
+        {
+            int first = bvhNode[nodeIdx].leftFirst;
+            reordered[next] = bvhNode[first];
+            reordered[next + 1] = bvhNode[first + 1];
+            newIdx[first] = next;
+            newIdx[first + 1] = next + 1;
+            reordered[newIdx[nodeIdx]].leftFirst = next;
+            next += 2;
+        }
+        bvhNode = std::move(reordered);
+        nodesUsed = next;
+        parent.clear();
+        freePairs.clear();
+    }
+    void clear() noexcept
+    {
+        bvhNode.clear();
+        centroid.clear();
+        aabb.clear();
+        triIdx.clear();
+        spheres.clear();
+        types.clear();
+        nodesUsed = 1;
+        nodeState.reset();
+        lazyNodesUsed.reset();
+        dropEdits();
+    }
+    bool hit(const ray& ray, float min_time, float max_time, hit_record& hit) const
+    {
+        if (types.only_triangles(!spheres.empty()))
+            return traverse<triangle>(ray, min_time, max_time, hit);
+        return traverse<hittable>(ray, min_time, max_time, hit);
+    }
+    [[nodiscard]] build_stats stats() const
+    {
+        build_stats stats;
+        stats.primitives = objects.size();
+        if (bvhNode.empty())
+            return stats;
+
+        const float rootArea = bvhNode[0].aabb.area();
+        std::vector<std::pair<int, int>> stack = {{0, 0}};
+        while (!stack.empty())
+        {
+            auto [nodeIdx, depth] = stack.back();
+            stack.pop_back();
+
+            const BVHNode& node = bvhNode[nodeIdx];
+            float area = rootArea > 0 ? node.aabb.area() / rootArea : 1.f;
+            if (node.isLeaf())
+            {
+                stats.add_leaf(depth, area, node.triCount, sah.intersect);
+            }
+            else
+            {
+                stats.add_inner(depth, area, sah.traverse);
+                stack.emplace_back(node.leftFirst, depth + 1);
+                stack.emplace_back(node.leftFirst + 1, depth + 1);
+            }
+        }
+        return stats;
+    }
+
+private:
+    // hit() with every leaf object tested as a Primitive
+    template <Hittable Primitive>
+    bool traverse(const ray& ray, float min_time, float max_time, hit_record& hit) const
+    {
+        // A root without children is an empty tree
+        if (bvhNode.empty() || (!bvhNode[0].isLeaf() && bvhNode[0].leftFirst == 0))
+            return false;
+
+        // Edited trees aren't as balanced as built ones
+        const BVHNode *node = &bvhNode[0], *stack[256];
+        int stackPtr = 0;
+        bool hitSomething = false;
+        const sphere_ray sphereRay(ray);
+
+        TRAVERSAL_STATS(stats);
+        STATS_ADD(stats, rays, 1);
+
+        while (true)
+        {
+            STATS_ADD(stats, nodes, 1);
+            if (nodeState)
+            {
+                int nodeIdx = (int)(node - bvhNode.data());
+                if (nodeState[nodeIdx].load(std::memory_order_acquire) != ready)
+                    expand(nodeIdx);
+            }
+            if (node->isLeaf())
+            {
+                STATS_ADD(stats, leaves, 1);
+                STATS_ADD(stats, primitives, node->triCount);
+                if (!spheres.empty())
+                {
+                    hitSomething |= spheres.hit<Primitive>(sphereRay, node->leftFirst,
+                                                           node->triCount, min_time, max_time, hit);
+                }
+                else
+                {
+                    hitSomething |=
+                        hit_objects<Primitive>(objects, triIdx.data() + node->leftFirst,
+                                               node->triCount, ray, min_time, max_time, hit);
+                }
+                if (stackPtr == 0)
+                    break;
+                else
+                    node = stack[--stackPtr];
+                continue;
+            }
+            const BVHNode* child1 = &bvhNode[node->leftFirst];
+            const BVHNode* child2 = &bvhNode[node->leftFirst + 1];
+            float dist1 = child1->aabb.intersection_time(ray, min_time, max_time).first;
+            float dist2 = child2->aabb.intersection_time(ray, min_time, max_time).first;
+            if (dist1 > dist2)
+            {
+                std::swap(dist1, dist2);
+                std::swap(child1, child2);
+            }
+            if (dist1 == 1e30f)
+            {
+                if (stackPtr == 0)
+                    break;
+                else
+                    node = stack[--stackPtr];
+            }
+            else
+            {
+                node = child1;
+                if (dist2 != 1e30f)
+                    stack[stackPtr++] = child2;
+            }
+        }
+        return hitSomething;
+    }
+    void restructureTreelet(int nodeIdx, std::vector<float>& cost) noexcept;
+    void expand(int nodeIdx) const;
+    void finishLazy();
+    void prepareEdits();
+    void dropEdits() noexcept
+    {
+        parent.clear();
+        leafOf.clear();
+        freePairs.clear();
+        freeSlots.clear();
+    }
+    int findSibling(const AABB& box) const;
+    int allocatePair();
+    void setSlot(int slot, int objectIdx);
+    void relink(int nodeIdx);
+    void refitUp(int nodeIdx);
+    void rotate(int nodeIdx);
+    void update_node_bounds(int nodeIdx) noexcept
+    {
+        BVHNode& node = bvhNode[nodeIdx];
+        node.aabb.min = glm::vec3(1e30f);
+        node.aabb.max = glm::vec3(-1e30f);
+        for (int first = node.leftFirst, i = 0; i < node.triCount; i++)
+        {
+            int leafTriIdx = triIdx[first + i];
+            const auto& leafTri = objects[leafTriIdx];
+            const AABB& leafTriBounds = aabb[leafTriIdx];
+
+            node.aabb.min = glm::min(node.aabb.min, leafTriBounds.min);
+            node.aabb.max = glm::max(node.aabb.max, leafTriBounds.max);
+        }
+    }
+    void subdivide(int nodeIdx) noexcept
+    {
+        int leftChildIdx = splitLeaf(nodeIdx,
+                                     [this]
+                                     {
+                                         nodesUsed += 2;
+                                         return nodesUsed - 2;
+                                     });
+        if (leftChildIdx == 0)
+            return;
+        subdivide(leftChildIdx);
+        subdivide(leftChildIdx + 1);
+    }
+    // Splits a leaf in two if the SAH says so, allocate() returns the index of the pair for the
+    // children. Returns the left child, or 0 when the node stays a leaf.
+    template <class Allocate>
+    int splitLeaf(int nodeIdx, Allocate&& allocate) noexcept
+    {
+        BVHNode& node = bvhNode[nodeIdx];
+        if (node.triCount <= sah.leaf_size)
+            return 0;
+        BVHBestAxisResult best = find_best_axis(node);
+
+        float parentArea = node.aabb.area();
+        float splitCost = sah.traverse * parentArea + sah.intersect * best.cost;
+        float leafCost = sah.intersect * (float)node.triCount * parentArea;
+        if (splitCost >= leafCost)
+            return 0;
+
+        int splitIdx = split(node, best);
+
+        int leftCount = splitIdx - node.leftFirst;
+        if (leftCount == 0 || leftCount == node.triCount)
+            return 0;
+        // create child nodes
+        int leftChildIdx = allocate();
+        int rightChildIdx = leftChildIdx + 1;
+        bvhNode[leftChildIdx].leftFirst = node.leftFirst;
+        bvhNode[leftChildIdx].triCount = leftCount;
+        bvhNode[rightChildIdx].leftFirst = splitIdx;
+        bvhNode[rightChildIdx].triCount = node.triCount - leftCount;
+        node.leftFirst = leftChildIdx;
+        node.triCount = 0;
+
+        update_node_bounds(leftChildIdx);
+        update_node_bounds(rightChildIdx);
+        return leftChildIdx;
+    }
+    int split(const BVHNode& node, const BVHBestAxisResult& best) noexcept
+    {
+        int i = node.leftFirst;
+        int j = i + node.triCount - 1;
+        while (i <= j)
+        {
+            if (centroid[triIdx[i]][best.axis] < best.pos)
+            {
+                i++;
+            }
+            else
+            {
+                std::swap(triIdx[i], triIdx[j--]);
+            }
+        }
+        return i;
+    }
+    [[nodiscard]] auto find_best_axis(const BVHNode& node) const -> BVHBestAxisResult
+    {
+        BVHBestAxisResult best = {-1, 0, 1e30f};
+
+        for (int axis = 0; axis < 3; axis++)
+        {
+            for (int i = 0; i < node.triCount; i++)
+            {
+                float candidatePos = centroid[triIdx[node.leftFirst + i]][axis];
+                float cost = evaluate_sah(node, axis, candidatePos);
+                if (cost < best.cost)
+                {
+                    best.pos = candidatePos, best.axis = axis, best.cost = cost;
+                }
+            }
+        }
+        return best;
+    }
+    [[nodiscard]] float evaluate_sah(const BVHNode& node, int axis, float pos) const noexcept
+    {
+        // determine triangle counts and bounds for this split candidate
+        AABB leftBox, rightBox;
+        int leftCount = 0, rightCount = 0;
+        for (int i = 0; i < node.triCount; i++)
+        {
+            auto tri_idx = triIdx[node.leftFirst + i];
+            const auto& triangle = objects[tri_idx];
+            const AABB& triBounds = aabb[tri_idx];
+            if (centroid[tri_idx][axis] < pos)
+            {
+                leftBox.min = glm::min(leftBox.min, triBounds.min);
+                leftBox.max = glm::max(leftBox.max, triBounds.max);
+                leftCount++;
+            }
+            else
+            {
+                rightBox.min = glm::min(rightBox.min, triBounds.min);
+                rightBox.max = glm::max(rightBox.max, triBounds.max);
+                rightCount++;
+            }
+        }
+        float left_area = leftBox.area(), right_area = rightBox.area();
+        float cost = (float)leftCount * left_area + (float)rightCount * right_area;
+        return cost > 0 ? cost : 1e30f;
+    }
+};
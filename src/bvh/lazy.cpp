@@ -0,0 +1,78 @@
+// Ray tracing with a cone tree
+// Copyright © 2022 otreblan
+//
+// cone-tree is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// cone-tree is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with cone-tree.  If not, see <http://www.gnu.org/licenses/>.
+
+
+// Lazy builds. Every node starts pending, as one leaf over its whole range of objects. The first
+// ray that reaches a pending node splits it one level, exactly like the eager build would, and its
+// children start pending too. Whoever wins the pending -> splitting transition does the work and
+// publishes it with the release store of ready; any other thread reaching the node meanwhile waits
+// for that store. A split only writes the node, its new children and the triIdx entries of its own
+// range, which nobody else reads until the node is ready.
+
+#include "bvh.hpp"
+
+#include <thread>
+
+void BVH::expand(int nodeIdx) const
+{
+    std::atomic<std::uint8_t>& state = nodeState[nodeIdx];
+    std::uint8_t expected = pending;
+    if (!state.compare_exchange_strong(expected, splitting, std::memory_order_acquire))
+    {
+        while (state.load(std::memory_order_acquire) != ready)
+            std::this_thread::yield();
+        return;
+    }
+
+    // Splitting is filling in what a const tree already promised to contain
+    auto* self = const_cast<BVH*>(this);
+    const int first = bvhNode[nodeIdx].leftFirst;
+    const int count = bvhNode[nodeIdx].triCount;
+    self->splitLeaf(nodeIdx, [this] { return lazyNodesUsed->fetch_add(2); });
+
+    // Partitioning reordered the range even if it then didn't split. Leaves only load their own
+    // slots, so no other thread reads these meanwhile.
+    if (!spheres.empty())
+    {
+        for (int slot = first; slot < first + count; slot++)
+            self->spheres.assign(slot, objects[triIdx[slot]].get());
+    }
+    state.store(ready, std::memory_order_release);
+}
+
+// Splits everything left, for whatever needs the whole tree
+void BVH::finishLazy()
+{
+    if (!nodeState)
+        return;
+
+    std::vector<int> stack = {0};
+    while (!stack.empty())
+    {
+        int nodeIdx = stack.back();
+        stack.pop_back();
+        if (nodeState[nodeIdx].load(std::memory_order_acquire) != ready)
+            expand(nodeIdx);
+        if (!bvhNode[nodeIdx].isLeaf() && bvhNode[nodeIdx].leftFirst != 0)
+        {
+            stack.push_back(bvhNode[nodeIdx].leftFirst);
+            stack.push_back(bvhNode[nodeIdx].leftFirst + 1);
+        }
+    }
+    nodesUsed = *lazyNodesUsed;
+    nodeState.reset();
+    lazyNodesUsed.reset();
+}
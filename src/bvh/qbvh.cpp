@@ -0,0 +1,302 @@
+// Ray tracing with a cone tree
+// Copyright © 2022 otreblan
+//
+// cone-tree is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// cone-tree is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with cone-tree.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "qbvh.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+void QBVH::build(const BVH& bvh)
+{
+    clear();
+    objects = &bvh.objects;
+    sah = bvh.sah;
+    types = bvh.types;
+    if (bvh.bvhNode.empty() || bvh.objects.empty())
+        return;
+
+    triIdx = bvh.triIdx;
+    nodes.reserve(bvh.nodesUsed / 2 + 1);
+
+    const BVHNode& root = bvh.bvhNode[0];
+    if (root.isLeaf())
+        emitLeaf(root.aabb, root.leftFirst, root.triCount);
+    else
+        collapse(bvh, 0);
+    spheres.build(bvh.objects, triIdx.data(), triIdx.size());
+}
+
+void QBVH::clear() noexcept
+{
+    nodes.clear();
+    triIdx.clear();
+    spheres.clear();
+    types.clear();
+}
+
+int QBVH::newNode(const AABB& box)
+{
+    int nodeIdx = (int)nodes.size();
+    QBVHNode& node = nodes.emplace_back();
+    node.origin = box.min;
+
+    for (int axis = 0; axis < 3; axis++)
+    {
+        // Smallest power of two step that covers the extent with 255 steps
+        float extent = box.max[axis] - box.min[axis];
+        int exponent = extent > 0 ? (int)std::ceil(std::log2(extent / 255.f)) : -100;
+        while (std::ldexp(255.f, exponent) < extent)
+            exponent++;
+        node.exponent[axis] = (std::int8_t)std::clamp(exponent, -100, 127);
+    }
+
+    std::fill(std::begin(node.count), std::end(node.count), QBVHNode::emptyChild);
+    return nodeIdx;
+}
+
+void QBVH::setChild(int nodeIdx, int slot, const AABB& box, int child, std::uint8_t count)
+{
+    QBVHNode& node = nodes[nodeIdx];
+    for (int axis = 0; axis < 3; axis++)
+    {
+        float scale = std::ldexp(1.f, node.exponent[axis]);
+        float lo = (box.min[axis] - node.origin[axis]) / scale;
+        float hi = (box.max[axis] - node.origin[axis]) / scale;
+        int qmin = std::clamp((int)std::floor(lo), 0, 255);
+        int qmax = std::clamp((int)std::ceil(hi), 0, 255);
+
+        // Float rounding in the decode must never shrink the box
+        while (qmin > 0 && node.origin[axis] + (float)qmin * scale > box.min[axis])
+            qmin--;
+        while (qmax < 255 && node.origin[axis] + (float)qmax * scale < box.max[axis])
+            qmax++;
+
+        node.qmin[axis][slot] = (std::uint8_t)qmin;
+        node.qmax[axis][slot] = (std::uint8_t)qmax;
+    }
+    node.child[slot] = child;
+    node.count[slot] = count;
+}
+
+AABB QBVH::childBox(const QBVHNode& node, int slot) const noexcept
+{
+    AABB box;
+    for (int axis = 0; axis < 3; axis++)
+    {
+        float scale = std::ldexp(1.f, node.exponent[axis]);
+        box.min[axis] = node.origin[axis] + (float)node.qmin[axis][slot] * scale;
+        box.max[axis] = node.origin[axis] + (float)node.qmax[axis][slot] * scale;
+    }
+    return box;
+}
+
+// Leaves too big for the 8 bit count are spread over several slots with the same box
+int QBVH::emitLeaf(const AABB& box, int first, int count)
+{
+    int nodeIdx = newNode(box);
+    int chunk = (count + QBVHNode::width - 1) / QBVHNode::width;
+    for (int slot = 0; slot < QBVHNode::width && count > 0; slot++)
+    {
+        int size = std::min(chunk, count);
+        if (size <= QBVHNode::maxLeafSize)
+            setChild(nodeIdx, slot, box, first, (std::uint8_t)size);
+        else
+            setChild(nodeIdx, slot, box, emitLeaf(box, first, size), QBVHNode::innerChild);
+        first += size;
+        count -= size;
+    }
+    return nodeIdx;
+}
+
+int QBVH::collapse(const BVH& bvh, int nodeIdx)
+{
+    const BVHNode& node = bvh.bvhNode[nodeIdx];
+
+    // Open the biggest inner child until there are four of them
+    std::vector<int> children = {node.leftFirst, node.leftFirst + 1};
+    while ((int)children.size() < QBVHNode::width)
+    {
+        auto biggest = children.end();
+        float biggestArea = -1.f;
+        for (auto it = children.begin(); it != children.end(); ++it)
+        {
+            const BVHNode& child = bvh.bvhNode[*it];
+            if (!child.isLeaf() && child.aabb.area() > biggestArea)
+            {
+                biggest = it;
+                biggestArea = child.aabb.area();
+            }
+        }
+        if (biggest == children.end())
+            break;
+
+        int opened = *biggest;
+        *biggest = bvh.bvhNode[opened].leftFirst;
+        children.push_back(bvh.bvhNode[opened].leftFirst + 1);
+    }
+
+    int qnodeIdx = newNode(node.aabb);
+    for (int slot = 0; slot < (int)children.size(); slot++)
+    {
+        const BVHNode& child = bvh.bvhNode[children[slot]];
+        if (!child.isLeaf())
+            setChild(qnodeIdx, slot, child.aabb, collapse(bvh, children[slot]),
+                     QBVHNode::innerChild);
+        else if (child.triCount <= QBVHNode::maxLeafSize)
+            setChild(qnodeIdx, slot, child.aabb, child.leftFirst, (std::uint8_t)child.triCount);
+        else
+            setChild(qnodeIdx, slot, child.aabb,
+                     emitLeaf(child.aabb, child.leftFirst, child.triCount),
+                     QBVHNode::innerChild);
+    }
+    return qnodeIdx;
+}
+
+bool QBVH::hit(const ray& ray, float min_time, float max_time, hit_record& hit) const
+{
+    if (types.only_triangles(!spheres.empty()))
+        return traverse<triangle>(ray, min_time, max_time, hit);
+    return traverse<hittable>(ray, min_time, max_time, hit);
+}
+
+template <Hittable Primitive>
+bool QBVH::traverse(const ray& ray, float min_time, float max_time, hit_record& hit) const
+{
+    if (nodes.empty())
+        return false;
+
+    // Children are pushed farthest first with their entry distance, so the nearest one is popped
+    // next and anything behind the closest hit so far is skipped without touching it
+    struct Entry
+    {
+        float t;
+        int ref;
+        int count;
+    };
+    Entry stack[256];
+    int stackPtr = 0;
+    stack[stackPtr++] = {min_time, 0, QBVHNode::innerChild};
+    bool hitSomething = false;
+
+    const glm::vec3 invDir = 1.f / ray.direction;
+    const sphere_ray sphereRay(ray);
+
+    TRAVERSAL_STATS(stats);
+    STATS_ADD(stats, rays, 1);
+
+    while (stackPtr > 0)
+    {
+        const Entry entry = stack[--stackPtr];
+        if (entry.t > max_time)
+            continue;
+
+        STATS_ADD(stats, nodes, 1);
+        if (entry.count != QBVHNode::innerChild)
+        {
+            STATS_ADD(stats, leaves, 1);
+            STATS_ADD(stats, primitives, entry.count);
+            if (!spheres.empty())
+            {
+                hitSomething |= spheres.hit<Primitive>(sphereRay, entry.ref, entry.count, min_time,
+                                                       max_time, hit);
+                continue;
+            }
+            hitSomething |= hit_objects<Primitive>(*objects, triIdx.data() + entry.ref, entry.count,
+                                                   ray, min_time, max_time, hit);
+            continue;
+        }
+
+        const QBVHNode& node = nodes[entry.ref];
+        glm::vec3 scale(std::ldexp(1.f, node.exponent[0]), std::ldexp(1.f, node.exponent[1]),
+                        std::ldexp(1.f, node.exponent[2]));
+
+        Entry children[QBVHNode::width];
+        int hits = 0;
+        for (int slot = 0; slot < QBVHNode::width; slot++)
+        {
+            if (node.count[slot] == QBVHNode::emptyChild)
+                continue;
+
+            float t0 = min_time;
+            float t1 = max_time;
+            for (int axis = 0; axis < 3; axis++)
+            {
+                float lo = node.origin[axis] + (float)node.qmin[axis][slot] * scale[axis];
+                float hi = node.origin[axis] + (float)node.qmax[axis][slot] * scale[axis];
+                float tLo = (lo - ray.origin[axis]) * invDir[axis];
+                float tHi = (hi - ray.origin[axis]) * invDir[axis];
+                t0 = std::max(t0, std::min(tLo, tHi));
+                t1 = std::min(t1, std::max(tLo, tHi));
+            }
+            if (t0 <= t1)
+                children[hits++] = {t0, node.child[slot], node.count[slot]};
+        }
+
+        std::sort(children, children + hits,
+                  [](const Entry& a, const Entry& b) { return a.t > b.t; });
+        for (int i = 0; i < hits; i++)
+            stack[stackPtr++] = children[i];
+    }
+    return hitSomething;
+}
+
+build_stats QBVH::stats() const
+{
+    build_stats stats;
+    stats.primitives = objects ? objects->size() : 0;
+    if (nodes.empty())
+        return stats;
+
+    // Same cost weights as the binary BVH
+    AABB rootBox;
+    for (int slot = 0; slot < QBVHNode::width; slot++)
+    {
+        if (nodes[0].count[slot] == QBVHNode::emptyChild)
+            continue;
+        AABB box = childBox(nodes[0], slot);
+        rootBox.min = glm::min(rootBox.min, box.min);
+        rootBox.max = glm::max(rootBox.max, box.max);
+    }
+    const float rootArea = rootBox.area();
+    auto relative = [&](const AABB& box) { return rootArea > 0 ? box.area() / rootArea : 1.f; };
+
+    stats.add_inner(0, 1.f, 1.f);
+    std::vector<std::pair<int, int>> stack = {{0, 0}};
+    while (!stack.empty())
+    {
+        auto [nodeIdx, depth] = stack.back();
+        stack.pop_back();
+
+        const QBVHNode& node = nodes[nodeIdx];
+        for (int slot = 0; slot < QBVHNode::width; slot++)
+        {
+            if (node.count[slot] == QBVHNode::emptyChild)
+                continue;
+
+            float area = relative(childBox(node, slot));
+            if (node.count[slot] == QBVHNode::innerChild)
+            {
+                stats.add_inner(depth + 1, area, sah.traverse);
+                stack.emplace_back(node.child[slot], depth + 1);
+            }
+            else
+                stats.add_leaf(depth + 1, area, node.count[slot], sah.intersect);
+        }
+    }
+    return stats;
+}
@@ -0,0 +1,76 @@
+// Ray tracing with a cone tree
+// Copyright © 2022 otreblan
+//
+// cone-tree is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// cone-tree is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with cone-tree.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "../math/aabb.hpp"
+#include "../object/hittable.hpp"
+#include "../stats.hpp"
+#include "bvh.hpp"
+
+// Four children per node, their bounds quantized to 8 bits inside the node box so the whole node
+// fits in one cache line. A child box decodes to origin + q * 2^exponent on every axis, and the
+// quantization always rounds outwards.
+struct alignas(64) QBVHNode
+{
+    static constexpr int width = 4;
+    static constexpr std::uint8_t emptyChild = 0;
+    static constexpr std::uint8_t innerChild = 0xff;
+    static constexpr int maxLeafSize = innerChild - 1;
+
+    glm::vec3 origin;
+    std::int8_t exponent[3];
+    std::uint8_t qmin[3][width]; // [axis][child], one axis of every child is contiguous
+    std::uint8_t qmax[3][width];
+    std::int32_t child[width];   // Node index of inner children, first triIdx of leaves
+    std::uint8_t count[width];   // emptyChild, innerChild or the leaf size
+};
+
+static_assert(sizeof(QBVHNode) == 64);
+
+// Read only copy of a built BVH with the compressed nodes, the BVH keeps owning the objects
+struct QBVH
+{
+public:
+    // Collapses every two levels of bvh into one node, bvh's own nodes can be freed afterwards
+    void build(const BVH& bvh);
+    void clear() noexcept;
+    bool hit(const ray& ray, float min_time, float max_time, hit_record& hit) const;
+    [[nodiscard]] build_stats stats() const;
+
+private:
+    const std::vector<std::unique_ptr<hittable>>* objects = nullptr;
+    std::vector<QBVHNode> nodes;
+    std::vector<int> triIdx;
+    sah_params sah; // Only weights stats(), copied from the BVH
+    sphere_store spheres; // In triIdx order
+    primitive_types types;  // Copied from the BVH
+
+    // hit() with every leaf object tested as a Primitive
+    template <Hittable Primitive>
+    bool traverse(const ray& ray, float min_time, float max_time, hit_record& hit) const;
+
+    int collapse(const BVH& bvh, int nodeIdx);
+    int emitLeaf(const AABB& box, int first, int count);
+    int newNode(const AABB& box);
+    void setChild(int nodeIdx, int slot, const AABB& box, int child, std::uint8_t count);
+    [[nodiscard]] AABB childBox(const QBVHNode& node, int slot) const noexcept;
+};
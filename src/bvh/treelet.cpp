@@ -0,0 +1,220 @@
+// Ray tracing with a cone tree
+// Copyright © 2022 otreblan
+//
+// cone-tree is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// cone-tree is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with cone-tree.  If not, see <http://www.gnu.org/licenses/>.
+
+
+// Treelet restructuring after Karras and Aila, "Fast Parallel Construction of High-Quality
+// Bounding Volume Hierarchies". Every inner node grows a treelet of up to seven subtrees, finds
+// the topology over them with the lowest SAH cost by dynamic programming over subsets and rewrites
+// the treelet in place, reusing the sibling pairs it already had.
+
+#include "bvh.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <thread>
+
+namespace
+{
+
+constexpr int treeletLeaves = 7;
+
+template <class F>
+void parallelFor(const std::vector<int>& items, F&& f)
+{
+    const std::size_t threads =
+        std::min<std::size_t>(std::max(1u, std::thread::hardware_concurrency()),
+                              items.size() / 64 + 1);
+    if (threads <= 1)
+    {
+        for (int item : items)
+            f(item);
+        return;
+    }
+
+    std::atomic<std::size_t> next = 0;
+    std::vector<std::thread> pool;
+    for (std::size_t t = 0; t < threads; t++)
+    {
+        pool.emplace_back(
+            [&]
+            {
+                for (std::size_t i = next++; i < items.size(); i = next++)
+                    f(items[i]);
+            });
+    }
+    for (auto& thread : pool)
+        thread.join();
+}
+
+} // namespace
+
+void BVH::optimizeTreelets(int rounds)
+{
+    if (bvhNode.empty() || bvhNode[0].isLeaf())
+        return;
+    parent.clear();
+
+    std::vector<float> cost(nodesUsed);
+    for (int round = 0; round < rounds; round++)
+    {
+        // Inner nodes by depth. Treelets rooted at the same depth never overlap, so every level
+        // runs in parallel, deepest first so the subtree costs below are already final.
+        std::vector<std::vector<int>> levels;
+        std::vector<std::pair<int, int>> stack = {{0, 0}};
+        std::vector<int> order;
+        while (!stack.empty())
+        {
+            auto [nodeIdx, depth] = stack.back();
+            stack.pop_back();
+            order.push_back(nodeIdx);
+
+            const BVHNode& node = bvhNode[nodeIdx];
+            if (node.isLeaf())
+                continue;
+            if ((int)levels.size() <= depth)
+                levels.resize(depth + 1);
+            levels[depth].push_back(nodeIdx);
+            stack.emplace_back(node.leftFirst, depth + 1);
+            stack.emplace_back(node.leftFirst + 1, depth + 1);
+        }
+
+        // Children come after their parent in order
+        for (auto it = order.rbegin(); it != order.rend(); ++it)
+        {
+            const BVHNode& node = bvhNode[*it];
+            if (node.isLeaf())
+                cost[*it] = sah.intersect * (float)node.triCount * node.aabb.area();
+            else
+                cost[*it] = sah.traverse * node.aabb.area() + cost[node.leftFirst] +
+                            cost[node.leftFirst + 1];
+        }
+
+        float before = cost[0];
+        for (int depth = (int)levels.size() - 1; depth >= 0; depth--)
+            parallelFor(levels[depth], [&](int nodeIdx) { restructureTreelet(nodeIdx, cost); });
+
+        // Another round is pointless once nothing moves
+        if (cost[0] >= before * 0.999f)
+            break;
+    }
+}
+
+void BVH::restructureTreelet(int nodeIdx, std::vector<float>& cost) noexcept
+{
+    constexpr int subsets = 1 << treeletLeaves;
+
+    // Grow the treelet by opening its biggest inner leaf, every opened node gives a sibling pair
+    int leaves[treeletLeaves];
+    int pairs[treeletLeaves - 1];
+    int leafCount = 2;
+    int pairCount = 1;
+    leaves[0] = bvhNode[nodeIdx].leftFirst;
+    leaves[1] = bvhNode[nodeIdx].leftFirst + 1;
+    pairs[0] = bvhNode[nodeIdx].leftFirst;
+
+    while (leafCount < treeletLeaves)
+    {
+        int biggest = -1;
+        float biggestArea = -1.f;
+        for (int i = 0; i < leafCount; i++)
+        {
+            const BVHNode& leaf = bvhNode[leaves[i]];
+            if (!leaf.isLeaf() && leaf.aabb.area() > biggestArea)
+            {
+                biggest = i;
+                biggestArea = leaf.aabb.area();
+            }
+        }
+        if (biggest < 0)
+            break;
+
+        int opened = bvhNode[leaves[biggest]].leftFirst;
+        pairs[pairCount++] = opened;
+        leaves[biggest] = opened;
+        leaves[leafCount++] = opened + 1;
+    }
+    if (leafCount < 3)
+        return;
+
+    // Best cost of every subset of the leaves, and the partition that gives it
+    AABB box[subsets];
+    float best[subsets];
+    int partition[subsets];
+    const int full = (1 << leafCount) - 1;
+    for (int s = 1; s <= full; s++)
+    {
+        int low = std::countr_zero((unsigned)s);
+        if (s == (1 << low))
+        {
+            box[s] = bvhNode[leaves[low]].aabb;
+            best[s] = cost[leaves[low]];
+            continue;
+        }
+
+        const AABB& rest = box[s & (s - 1)];
+        box[s].min = glm::min(rest.min, bvhNode[leaves[low]].aabb.min);
+        box[s].max = glm::max(rest.max, bvhNode[leaves[low]].aabb.max);
+
+        // Each partition once, the side with the lowest leaf is p
+        best[s] = 1e30f;
+        for (int p = (s - 1) & s; p > 0; p = (p - 1) & s)
+        {
+            if (!(p & (1 << low)))
+                continue;
+            float c = best[p] + best[s ^ p];
+            if (c < best[s])
+            {
+                best[s] = c;
+                partition[s] = p;
+            }
+        }
+        best[s] += sah.traverse * box[s].area();
+    }
+
+    if (best[full] >= cost[nodeIdx] * 0.9999f)
+        return;
+
+    BVHNode leafNodes[treeletLeaves];
+    float leafCosts[treeletLeaves];
+    for (int i = 0; i < leafCount; i++)
+    {
+        leafNodes[i] = bvhNode[leaves[i]];
+        leafCosts[i] = cost[leaves[i]];
+    }
+
+    int nextPair = 0;
+    auto emit = [&](auto& self, int s, int slot) -> void
+    {
+        if (std::has_single_bit((unsigned)s))
+        {
+            int i = std::countr_zero((unsigned)s);
+            bvhNode[slot] = leafNodes[i];
+            cost[slot] = leafCosts[i];
+            return;
+        }
+
+        int pair = pairs[nextPair++];
+        BVHNode& node = bvhNode[slot];
+        node.aabb = box[s];
+        node.leftFirst = pair;
+        node.triCount = 0;
+        cost[slot] = best[s];
+        self(self, partition[s], pair);
+        self(self, s ^ partition[s], pair + 1);
+    };
+    emit(emit, full, nodeIdx);
+}
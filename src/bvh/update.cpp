@@ -0,0 +1,308 @@
+// Ray tracing with a cone tree
+// Copyright © 2022 otreblan
+//
+// cone-tree is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// cone-tree is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with cone-tree.  If not, see <http://www.gnu.org/licenses/>.
+
+
+// Edits of a built BVH. A new object gets a leaf of its own next to the node where it adds the
+// least surface area, found by branch and bound as in Bittner et al., "Fast Insertion-Based
+// Optimization of Bounding Volume Hierarchies". A removed object takes its leaf with it once the
+// leaf is empty. An updated object stays in its leaf. On the way back to the root every ancestor
+// is refit and tries the child and grandchild swaps of Kopta et al., "Fast, Effective BVH Updates
+// for Animated Scenes".
+
+#include "bvh.hpp"
+
+#include <functional>
+#include <queue>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+namespace
+{
+
+AABB merge(const AABB& a, const AABB& b) { return {glm::min(a.min, b.min), glm::max(a.max, b.max)}; }
+
+// Pairs start at node 1, so left children are odd
+int sibling(int nodeIdx) { return nodeIdx & 1 ? nodeIdx + 1 : nodeIdx - 1; }
+
+} // namespace
+
+int BVH::insert(std::unique_ptr<hittable>&& object)
+{
+    prepareEdits();
+
+    const int objectIdx = (int)objects.size();
+    aabb.push_back(object->bounding_box());
+    centroid.push_back(object->centroid());
+    types.add(object.get());
+    objects.push_back(std::move(object));
+    leafOf.push_back(-1);
+
+    int slot = (int)triIdx.size();
+    if (!freeSlots.empty())
+    {
+        slot = freeSlots.back();
+        freeSlots.pop_back();
+    }
+    else
+    {
+        triIdx.push_back(-1);
+    }
+    setSlot(slot, objectIdx);
+
+    BVHNode leaf;
+    leaf.aabb = aabb[objectIdx];
+    leaf.leftFirst = slot;
+    leaf.triCount = 1;
+
+    if (!bvhNode[0].isLeaf() && bvhNode[0].leftFirst == 0)
+    {
+        bvhNode[0] = leaf;
+        leafOf[objectIdx] = 0;
+        return objectIdx;
+    }
+
+    // The sibling moves down into a new pair next to the leaf and its node becomes their parent
+    const int siblingIdx = findSibling(leaf.aabb);
+    const int first = allocatePair();
+    bvhNode[first] = bvhNode[siblingIdx];
+    bvhNode[first + 1] = leaf;
+    relink(first);
+    relink(first + 1);
+    parent[first] = parent[first + 1] = siblingIdx;
+
+    bvhNode[siblingIdx].leftFirst = first;
+    bvhNode[siblingIdx].triCount = 0;
+    refitUp(siblingIdx);
+    return objectIdx;
+}
+
+void BVH::remove(int objectIdx)
+{
+    prepareEdits();
+    if (objectIdx < 0 || objectIdx >= (int)objects.size() || leafOf[objectIdx] < 0)
+        throw std::runtime_error("Unknown object: " + std::to_string(objectIdx));
+
+    // The last entry of the leaf fills the hole
+    const int leafIdx = leafOf[objectIdx];
+    BVHNode& leaf = bvhNode[leafIdx];
+    const int last = leaf.leftFirst + leaf.triCount - 1;
+    int slot = leaf.leftFirst;
+    while (triIdx[slot] != objectIdx)
+        slot++;
+    setSlot(slot, triIdx[last]);
+    setSlot(last, -1);
+    freeSlots.push_back(last);
+    leaf.triCount--;
+
+    objects[objectIdx].reset();
+    leafOf[objectIdx] = -1;
+
+    if (leaf.triCount > 0)
+    {
+        refitUp(leafIdx);
+        return;
+    }
+    if (leafIdx == 0)
+    {
+        bvhNode[0] = BVHNode{};
+        return;
+    }
+
+    // The sibling takes the place of their parent
+    const int parentIdx = parent[leafIdx];
+    const int siblingIdx = sibling(leafIdx);
+    bvhNode[parentIdx] = bvhNode[siblingIdx];
+    relink(parentIdx);
+    freePairs.push_back(std::min(leafIdx, siblingIdx));
+    if (parent[parentIdx] >= 0)
+        refitUp(parent[parentIdx]);
+}
+
+void BVH::update(int objectIdx, std::unique_ptr<hittable>&& object)
+{
+    prepareEdits();
+    if (objectIdx < 0 || objectIdx >= (int)objects.size() || leafOf[objectIdx] < 0)
+        throw std::runtime_error("Unknown object: " + std::to_string(objectIdx));
+
+    aabb[objectIdx] = object->bounding_box();
+    centroid[objectIdx] = object->centroid();
+    types.add(object.get());
+    objects[objectIdx] = std::move(object);
+
+    const int leafIdx = leafOf[objectIdx];
+    int slot = bvhNode[leafIdx].leftFirst;
+    while (triIdx[slot] != objectIdx)
+        slot++;
+    setSlot(slot, objectIdx);
+    refitUp(leafIdx);
+}
+
+void BVH::prepareEdits()
+{
+    // Edits move nodes around, which would race with lazy splits
+    finishLazy();
+    if (bvhNode.empty())
+    {
+        bvhNode.assign(2, {});
+        nodesUsed = 1;
+    }
+    if (!parent.empty())
+        return;
+
+    parent.assign(bvhNode.size(), -1);
+    leafOf.assign(objects.size(), -1);
+    if (!bvhNode[0].isLeaf() && bvhNode[0].leftFirst == 0)
+        return;
+
+    std::vector<int> stack = {0};
+    while (!stack.empty())
+    {
+        int nodeIdx = stack.back();
+        stack.pop_back();
+        relink(nodeIdx);
+        if (!bvhNode[nodeIdx].isLeaf())
+        {
+            stack.push_back(bvhNode[nodeIdx].leftFirst);
+            stack.push_back(bvhNode[nodeIdx].leftFirst + 1);
+        }
+    }
+}
+
+int BVH::findSibling(const AABB& box) const
+{
+    const float boxArea = box.area();
+    int best = 0;
+    float bestCost = merge(bvhNode[0].aabb, box).area();
+
+    // Ordered by how much the ancestors of a node grow if box goes below it, which is also a lower
+    // bound of the cost of anything in its subtree
+    using Entry = std::pair<float, int>;
+    std::priority_queue<Entry, std::vector<Entry>, std::greater<>> queue;
+    queue.emplace(0.f, 0);
+    while (!queue.empty())
+    {
+        auto [inherited, nodeIdx] = queue.top();
+        queue.pop();
+        if (inherited + boxArea >= bestCost)
+            break;
+
+        const BVHNode& node = bvhNode[nodeIdx];
+        const float direct = merge(node.aabb, box).area();
+        if (inherited + direct < bestCost)
+        {
+            bestCost = inherited + direct;
+            best = nodeIdx;
+        }
+        if (node.isLeaf())
+            continue;
+
+        const float below = inherited + direct - node.aabb.area();
+        if (below + boxArea < bestCost)
+        {
+            queue.emplace(below, node.leftFirst);
+            queue.emplace(below, node.leftFirst + 1);
+        }
+    }
+    return best;
+}
+
+int BVH::allocatePair()
+{
+    if (!freePairs.empty())
+    {
+        int first = freePairs.back();
+        freePairs.pop_back();
+        return first;
+    }
+
+    int first = nodesUsed;
+    nodesUsed += 2;
+    if ((int)bvhNode.size() < nodesUsed)
+        bvhNode.resize(nodesUsed);
+    parent.resize(bvhNode.size(), -1);
+    return first;
+}
+
+void BVH::setSlot(int slot, int objectIdx)
+{
+    triIdx[slot] = objectIdx;
+    if (!spheres.empty())
+        spheres.assign(slot, objectIdx >= 0 ? objects[objectIdx].get() : nullptr);
+}
+
+// Points whatever hangs from nodeIdx back at it, after its contents moved there
+void BVH::relink(int nodeIdx)
+{
+    const BVHNode& node = bvhNode[nodeIdx];
+    if (node.isLeaf())
+    {
+        for (int i = 0; i < node.triCount; i++)
+            leafOf[triIdx[node.leftFirst + i]] = nodeIdx;
+    }
+    else
+    {
+        parent[node.leftFirst] = parent[node.leftFirst + 1] = nodeIdx;
+    }
+}
+
+void BVH::refitUp(int nodeIdx)
+{
+    for (; nodeIdx >= 0; nodeIdx = parent[nodeIdx])
+    {
+        if (bvhNode[nodeIdx].isLeaf())
+        {
+            update_node_bounds(nodeIdx);
+            continue;
+        }
+        rotate(nodeIdx);
+        BVHNode& node = bvhNode[nodeIdx];
+        node.aabb = merge(bvhNode[node.leftFirst].aabb, bvhNode[node.leftFirst + 1].aabb);
+    }
+}
+
+// Swaps a child of nodeIdx with a grandchild on the other side when that shrinks the other child
+// the most. The bounds of nodeIdx itself don't change.
+void BVH::rotate(int nodeIdx)
+{
+    const int left = bvhNode[nodeIdx].leftFirst;
+    float bestGain = 0.f;
+    int down = -1, up = -1;
+
+    auto consider = [&](int child, int other)
+    {
+        const BVHNode& node = bvhNode[other];
+        if (node.isLeaf())
+            return;
+        for (int grandchild : {node.leftFirst, node.leftFirst + 1})
+        {
+            float area = merge(bvhNode[child].aabb, bvhNode[sibling(grandchild)].aabb).area();
+            float gain = node.aabb.area() - area;
+            if (gain > bestGain)
+                bestGain = gain, down = child, up = grandchild;
+        }
+    };
+    consider(left, left + 1);
+    consider(left + 1, left);
+    if (down < 0)
+        return;
+
+    std::swap(bvhNode[down], bvhNode[up]);
+    relink(down);
+    relink(up);
+    BVHNode& other = bvhNode[parent[up]];
+    other.aabb = merge(bvhNode[other.leftFirst].aabb, bvhNode[other.leftFirst + 1].aabb);
+}
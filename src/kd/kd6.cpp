@@ -1,5 +1,7 @@
 #include "kd6.hpp"
+#include "../object/triangle.hpp"
 #include <algorithm>
+#include <array>
 #include <numeric>
 
 struct AABBSplit
@@ -57,23 +59,21 @@ struct Event
     }
 };
 
-constexpr auto COST_TRAVERSE = 1.0f;
-constexpr auto COST_INTERSECT = 1.5f;
-
 static AABBSplit splitAABB(const AABB& aabb, const SplitPlane& plane);
 
 static float surfaceArea(const AABB& V);
 
 static float hitProbability(const AABB& Vsub, const AABB& V);
 
-static float lambda(int NL, int NR, float PL, float PR);
+static float lambda(int NL, int NR, float PL, float PR, const sah_params& sah);
 
-static float cost(float PL, float PR, int NL, int NR);
+static float cost(float PL, float PR, int NL, int NR, const sah_params& sah);
 
-static bool stopSplitting(int N, float minCv);
+static bool stopSplitting(int N, float minCv, const sah_params& sah);
 
 // TODO: Use SAH
-static SAHResult SAH(const SplitPlane& p, const AABB& V, int NL, int NR, int NP);
+static SAHResult SAH(const SplitPlane& p, const AABB& V, int NL, int NR, int NP,
+                     const sah_params& sah);
 
 static AABB clipTriangleToBox(int objectId, const AABB& V, const KDTree& tree)
 {
@@ -141,7 +141,7 @@ static SplitResult findPlane(const std::vector<int>& T, const AABB& V, int depth
             NR -= pLyingOnPlane;
             NR -= pEndingOnPlane;
 
-            const auto [C, pside] = SAH(p, V, NL, NR, NP);
+            const auto [C, pside] = SAH(p, V, NL, NR, NP, tree.sah);
             if (C < bestSplit.cost)
             {
                 bestSplit.cost = C;
@@ -189,7 +189,7 @@ static std::unique_ptr<KDTreeNode> buildRec(const std::vector<int>& objectIds, c
                                          int depth, const KDTree& tree)
 {
     auto plane = findPlane(objectIds, aabb, depth, tree);
-    if (stopSplitting(objectIds.size(), plane.cost))
+    if (stopSplitting(objectIds.size(), plane.cost, tree.sah))
     {
         auto node = std::make_unique<KDTreeNodeLeaf>();
         node->objectIds = objectIds;
@@ -208,77 +208,210 @@ static std::unique_ptr<KDTreeNode> buildRec(const std::vector<int>& objectIds, c
     return node;
 }
 
-bool KDTreeNodeLeaf::hit(const ray& r, float t_min, float t_max, hit_record& rec,
-                         const KDTree& tree) const
+bool KDTree::hit(const ray& ray, float t_min, float t_max, hit_record& hit) const
+{
+    if (types.only_triangles(!spheres.empty()))
+        return traverse<triangle>(ray, t_min, t_max, hit);
+    return traverse<hittable>(ray, t_min, t_max, hit);
+}
+
+template <Hittable Primitive>
+bool KDTree::traverse(const ray& ray, float t_min, float t_max, hit_record& hit) const
 {
-    auto bound_times = aabb.intersection_time(r, 0, t_min);
-    t_min = glm::max(t_min, bound_times.first);
-    t_max = glm::min(t_max, bound_times.second);
+    TRAVERSAL_STATS(stats);
+    STATS_ADD(stats, rays, 1);
+
+    if (nodes.empty())
+        return false;
 
-    bool hit = false;
+    // Far children wait on the stack with their node bounds and the split distance. A far child is
+    // dropped once there is a hit in front of its split.
+    struct Entry
+    {
+        std::uint32_t node;
+        float t_split;
+        AABB aabb;
+    };
+    Entry stack[256];
+    int stack_ptr = 0;
+    stack[stack_ptr++] = {0, -1e30f, bounds};
+
+    bool hit_anything = false;
+    const sphere_ray ray_consts(ray);
     float closest_so_far = t_max;
-    for (int object_idx : objectIds)
+    while (stack_ptr > 0)
     {
-        hit_record temp_rec;
-        const auto& object = tree.objects[object_idx];
-        if (object->hit(r, t_min, closest_so_far, temp_rec))
+        const Entry entry = stack[--stack_ptr];
+        if (hit_anything && closest_so_far <= entry.t_split)
+            continue;
+
+        const KDFlatNode& node = nodes[entry.node];
+        STATS_ADD(stats, nodes, 1);
+
+        if (node.isLeaf())
         {
-            hit = true;
-            closest_so_far = temp_rec.t;
-            rec = temp_rec;
+            STATS_ADD(stats, leaves, 1);
+            STATS_ADD(stats, primitives, node.count);
+            STATS_ADD(stats, empty_leaves, node.count == 0);
+
+            if (!spheres.empty())
+            {
+                hit_anything |= spheres.hit<Primitive>(ray_consts, node.index(), node.count, t_min,
+                                                       closest_so_far, hit);
+                continue;
+            }
+            hit_anything |= hit_objects<Primitive>(objects, leafObjects.data() + node.index(),
+                                                   node.count, ray, t_min, closest_so_far, hit);
+            continue;
+        }
+
+        // The node bounds only decide which children are visited, objects are always tested
+        // against the whole query interval so geometry lying on a node boundary isn't lost to
+        // rounding.
+        auto [t_enter, t_exit] = entry.aabb.intersection_time(ray, t_min, closest_so_far);
+        if (t_enter == 1e30f)
+            continue;
+        t_enter = glm::max(t_min, t_enter);
+        t_exit = glm::min(closest_so_far, t_exit);
+
+        const int axis = node.axis();
+        const SplitPlane plane(axis, node.split);
+        float t_split = (node.split - ray.origin[axis]) *
+                        (ray.direction[axis] == 0 ? 1e30f : 1 / ray.direction[axis]);
+
+        auto [left, right] = splitAABB(entry.aabb, plane);
+        bool left_near = ray.origin[axis] < node.split;
+        Entry near = {node.index() + (left_near ? 0 : 1), -1e30f, left_near ? left : right};
+        Entry far = {node.index() + (left_near ? 1 : 0), -1e30f, left_near ? right : left};
+
+        if (t_split > t_exit || t_split < 0)
+        {
+            stack[stack_ptr++] = near;
+        }
+        else if (t_split < t_enter)
+        {
+            stack[stack_ptr++] = far;
+        }
+        else
+        {
+            far.t_split = t_split;
+            stack[stack_ptr++] = far;
+            stack[stack_ptr++] = near;
         }
     }
-    return hit;
+    return hit_anything;
 }
 
-bool KDTreeNodeInternal::hit(const ray& ray, float t_min, float t_max, hit_record& hit,
-                             const KDTree& tree) const
+build_stats KDTree::stats() const
 {
-    auto bound_times = aabb.intersection_time(ray, 0, t_max);
-    t_min = glm::max(t_min, bound_times.first);
-    t_max = glm::min(t_max, bound_times.second);
+    build_stats stats;
+    stats.primitives = objects.size();
+    if (nodes.empty())
+        return stats;
 
-    float t_split =
-        (splitPlane.pos - ray.origin[splitPlane.axis]) *
-        (ray.direction[splitPlane.axis] == 0 ? 1e30f : 1 / ray.direction[splitPlane.axis]);
+    const float rootArea = bounds.area();
+    struct Entry
+    {
+        std::uint32_t node;
+        int depth;
+        AABB aabb;
+    };
+    std::vector<Entry> stack = {{0, 0, bounds}};
+    while (!stack.empty())
+    {
+        auto [nodeIdx, depth, aabb] = stack.back();
+        stack.pop_back();
 
-    auto near = ray.origin[splitPlane.axis] < splitPlane.pos ? left.get() : right.get();
-    auto far = ray.origin[splitPlane.axis] < splitPlane.pos ? right.get() : left.get();
+        const KDFlatNode& node = nodes[nodeIdx];
+        float area = rootArea > 0 ? aabb.area() / rootArea : 1.f;
+        if (node.isLeaf())
+        {
+            stats.add_leaf(depth, area, (int)node.count, sah.intersect);
+        }
+        else
+        {
+            stats.add_inner(depth, area, sah.traverse);
+            auto [left, right] = splitAABB(aabb, SplitPlane(node.axis(), node.split));
+            stack.push_back({node.index(), depth + 1, left});
+            stack.push_back({node.index() + 1, depth + 1, right});
+        }
+    }
+    return stats;
+}
 
-    if (t_split > t_max || t_split < 0)
+// Numbers the pointer tree, lets pair_order() pick where every sibling pair goes and writes the
+// flat nodes in that order. Leaf objects are stored in the same order as their leaves.
+static void flatten(const KDTreeNode& root, node_layout layout, std::vector<KDFlatNode>& nodes,
+                    std::vector<int>& leafObjects)
+{
+    std::vector<const KDTreeNode*> numbered = {&root};
+    std::vector<std::array<int, 2>> children;
+    std::vector<float> weight;
+    for (std::size_t i = 0; i < numbered.size(); ++i)
     {
-        return near->hit(ray, t_min, t_max, hit, tree);
+        const KDTreeNode* node = numbered[i];
+        if (node->is_leaf())
+        {
+            children.push_back({-1, -1});
+            weight.push_back(static_cast<const KDTreeNodeLeaf*>(node)->aabb.area());
+            continue;
+        }
+        const auto* inner = static_cast<const KDTreeNodeInternal*>(node);
+        children.push_back({(int)numbered.size(), (int)numbered.size() + 1});
+        weight.push_back(inner->aabb.area());
+        numbered.push_back(inner->left.get());
+        numbered.push_back(inner->right.get());
     }
-    else if (t_split < t_min)
+
+    std::vector<int> position(numbered.size());
+    std::uint32_t next = 1;
+    for (int node : pair_order(layout, children, weight))
     {
-        return far->hit(ray, t_min, t_max, hit, tree);
+        position[children[node][0]] = (int)next;
+        position[children[node][1]] = (int)next + 1;
+        next += 2;
     }
-    else
-    {
-        bool hit_anything = near->hit(ray, t_min, t_split, hit, tree);
-        if (hit.t < t_split)
-            return hit_anything;
 
-        hit_anything |= far->hit(ray, t_split, t_max, hit, tree);
-        return hit_anything;
-    }
-}
+    std::vector<int> at(numbered.size());
+    for (std::size_t i = 0; i < numbered.size(); ++i)
+        at[position[i]] = (int)i;
 
-bool KDTree::hit(const ray& r, float t_min, float t_max, hit_record& rec) const
-{
-    return root->hit(r, t_min, t_max, rec, *this);
+    nodes.assign(numbered.size(), {});
+    leafObjects.clear();
+    for (std::size_t p = 0; p < at.size(); ++p)
+    {
+        int i = at[p];
+        KDFlatNode& flat = nodes[p];
+        if (numbered[i]->is_leaf())
+        {
+            const auto* leaf = static_cast<const KDTreeNodeLeaf*>(numbered[i]);
+            flat.count = (std::uint32_t)leaf->objectIds.size();
+            flat.bits = (std::uint32_t)leafObjects.size() << 2 | 3;
+            leafObjects.insert(leafObjects.end(), leaf->objectIds.begin(), leaf->objectIds.end());
+        }
+        else
+        {
+            const auto* inner = static_cast<const KDTreeNodeInternal*>(numbered[i]);
+            flat.split = inner->splitPlane.pos;
+            flat.bits = (std::uint32_t)position[children[i][0]] << 2 | inner->splitPlane.axis;
+        }
+    }
 }
 
 void KDTree::clear()
 {
     objects.clear();
-    root.reset();
+    nodes.clear();
+    leafObjects.clear();
+    spheres.clear();
+    types.clear();
 }
 
 void KDTree::add(std::unique_ptr<hittable>&& object) { objects.push_back(std::move(object)); }
 
-void KDTree::build()
+void KDTree::build(node_layout layout, const sah_params& params)
 {
+    sah = params;
     const auto n = objects.size();
     aabbs = std::make_unique<AABB[]>(n);
     for (int i = 0; i < n; ++i)
@@ -295,7 +428,14 @@ void KDTree::build()
         aabb.min = glm::min(aabb.min, aabbs[i].min);
         aabb.max = glm::max(aabb.max, aabbs[i].max);
     }
-    root = buildRec(node->objectIds, aabb, 0, *this);
+    bounds = aabb;
+
+    // Only the flat copy is kept
+    auto root = buildRec(node->objectIds, aabb, 0, *this);
+    flatten(*root, layout, nodes, leafObjects);
+    spheres.build(objects, leafObjects.data(), leafObjects.size());
+    types.clear();
+    types.add(objects);
 }
 
 AABBSplit splitAABB(const AABB& aabb, const SplitPlane& plane)
@@ -312,21 +452,24 @@ float surfaceArea(const AABB& V) { return 2 * V.area(); }
 
 float hitProbability(const AABB& Vsub, const AABB& V) { return surfaceArea(Vsub) / surfaceArea(V); }
 
-float lambda(int NL, int NR, float PL, float PR)
+float lambda(int NL, int NR, float PL, float PR, const sah_params& sah)
 {
     if ((NL == 0 || NR == 0) && !(PL == 1 || PR == 1))
-        return 0.8f;
+        return sah.empty_bonus;
     return 1.0f;
 }
 
-float cost(float PL, float PR, int NL, int NR)
+float cost(float PL, float PR, int NL, int NR, const sah_params& sah)
 {
-    return (lambda(NL, NR, PL, PR) * (COST_TRAVERSE + COST_INTERSECT * (PL * NL + PR * NR)));
+    return (lambda(NL, NR, PL, PR, sah) * (sah.traverse + sah.intersect * (PL * NL + PR * NR)));
 }
 
-bool stopSplitting(int N, float minCv) { return (minCv > COST_INTERSECT * (float)N); }
+bool stopSplitting(int N, float minCv, const sah_params& sah)
+{
+    return (N <= sah.leaf_size || minCv > sah.intersect * (float)N);
+}
 
-SAHResult SAH(const SplitPlane& p, const AABB& V, int NL, int NR, int NP)
+SAHResult SAH(const SplitPlane& p, const AABB& V, int NL, int NR, int NP, const sah_params& sah)
 {
     auto [left, right] = splitAABB(V, p);
     float PL = hitProbability(left, V);
@@ -335,9 +478,12 @@ SAHResult SAH(const SplitPlane& p, const AABB& V, int NL, int NR, int NP)
         return {INFINITY};
     if (V.min[p.axis] - V.max[p.axis] == 0)
         return {INFINITY};
+    // A plane on the boundary doesn't split anything, it would only recurse forever
+    if (p.pos <= V.min[p.axis] || p.pos >= V.max[p.axis])
+        return {INFINITY, PlaneSide::LEFT};
 
-    float CPL = cost(PL, PR, NL + NP, NR);
-    float CPR = cost(PL, PR, NL, NP + NR);
+    float CPL = cost(PL, PR, NL + NP, NR, sah);
+    float CPR = cost(PL, PR, NL, NP + NR, sah);
     if (CPL < CPR)
         return {CPL, PlaneSide::LEFT};
     else
@@ -1,8 +1,14 @@
 
 #pragma once
 
+#include "../layout.hpp"
 #include "../math/aabb.hpp"
 #include "../object/hittable.hpp"
+#include "../object/primitive_types.hpp"
+#include "../object/sphere_store.hpp"
+#include "../sah.hpp"
+#include "../stats.hpp"
+#include <cstdint>
 #include <vector>
 
 struct SplitPlane
@@ -22,7 +28,6 @@ struct KDTreeNode {
     KDTreeNode() = default;
     virtual ~KDTreeNode() = default;
 
-    virtual bool hit(const ray& r, float t_min, float t_max, hit_record& rec, const KDTree& tree) const = 0;
     virtual bool is_leaf() const noexcept = 0;
 };
 
@@ -34,7 +39,6 @@ struct KDTreeNodeLeaf : public KDTreeNode {
 
     KDTreeNodeLeaf() = default;
 
-    bool hit(const ray& r, float t_min, float t_max, hit_record& rec, const KDTree& tree) const override;
     inline bool is_leaf() const noexcept override { return true; }
 };
 
@@ -46,20 +50,50 @@ struct KDTreeNodeInternal : public KDTreeNode {
 
     KDTreeNodeInternal() = default;
 
-    bool hit(const ray& r, float t_min, float t_max, hit_record& hit, const KDTree& tree) const override;
     inline bool is_leaf() const noexcept override { return false; }
 };
 
+// The tree the builder makes is flattened into these once it's done. The two children of an inner
+// node are next to each other, and their order in the array is set by a node_layout.
+struct KDFlatNode
+{
+    union
+    {
+        float split;         // Inner nodes
+        std::uint32_t count; // Leaves, number of objects
+    };
+    // Low two bits are the split axis, or 3 for leaves. The rest is the index of the left child,
+    // the right one follows it, or where the objects of a leaf start in KDTree::leafObjects.
+    std::uint32_t bits;
+
+    [[nodiscard]] bool isLeaf() const noexcept { return (bits & 3) == 3; }
+    [[nodiscard]] int axis() const noexcept { return (int)(bits & 3); }
+    [[nodiscard]] std::uint32_t index() const noexcept { return bits >> 2; }
+};
+
+static_assert(sizeof(KDFlatNode) == 8);
+
 struct KDTree
 {
     std::vector<std::unique_ptr<hittable>> objects;
-    std::unique_ptr<KDTreeNode> root;
     std::unique_ptr<AABB[]> aabbs;
 
+    std::vector<KDFlatNode> nodes;
+    std::vector<int> leafObjects;
+    sphere_store spheres; // In leafObjects order
+    primitive_types types;
+    AABB bounds;
+    sah_params sah;
+
 public:
     void add(std::unique_ptr<hittable>&& object);
-    void build();
+    void build(node_layout layout = node_layout::build, const sah_params& params = {});
     void clear();
     bool hit(const ray& r, float t_min, float t_max, hit_record& rec) const;
+    build_stats stats() const;
 
+private:
+    // hit() with every leaf object tested as a Primitive
+    template <Hittable Primitive>
+    bool traverse(const ray& r, float t_min, float t_max, hit_record& rec) const;
 };
\ No newline at end of file
@@ -0,0 +1,140 @@
+// Ray tracing with a cone tree
+// Copyright © 2022 otreblan
+//
+// cone-tree is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// cone-tree is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with cone-tree.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "layout.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+node_layout parse_node_layout(std::string_view name)
+{
+    if (name == "build")
+        return node_layout::build;
+    else if (name == "dfs")
+        return node_layout::dfs;
+    else if (name == "veb")
+        return node_layout::veb;
+
+    throw std::runtime_error("Unknown node layout: \"" + std::string(name) + "\"");
+}
+
+namespace
+{
+
+struct veb_layout
+{
+    const std::vector<std::array<int, 2>>& children;
+    std::vector<int> height; // Levels of inner nodes below and including the node
+    std::vector<int>& order;
+
+    [[nodiscard]] bool inner(int node) const { return children[node][0] >= 0; }
+
+    // Pairs of the inner nodes less than levels deep below node
+    void layout(int node, int levels)
+    {
+        if (!inner(node) || levels <= 0)
+            return;
+        if (levels == 1)
+        {
+            order.push_back(node);
+            return;
+        }
+
+        int top = levels / 2;
+        layout(node, top);
+
+        // Roots of the bottom subtrees, left to right
+        std::vector<std::pair<int, int>> stack = {{node, 0}};
+        std::vector<int> bottoms;
+        while (!stack.empty())
+        {
+            auto [n, depth] = stack.back();
+            stack.pop_back();
+            if (!inner(n))
+                continue;
+            if (depth == top)
+            {
+                bottoms.push_back(n);
+                continue;
+            }
+            stack.emplace_back(children[n][1], depth + 1);
+            stack.emplace_back(children[n][0], depth + 1);
+        }
+
+        for (int bottom : bottoms)
+            layout(bottom, std::min(levels - top, height[bottom]));
+    }
+};
+
+} // namespace
+
+std::vector<int> pair_order(node_layout layout, const std::vector<std::array<int, 2>>& children,
+                            const std::vector<float>& weight)
+{
+    std::vector<int> order;
+    if (children.empty() || children[0][0] < 0)
+        return order;
+    order.reserve(children.size() / 2 + 1);
+
+    if (layout == node_layout::veb)
+    {
+        veb_layout veb{children, std::vector<int>(children.size()), order};
+
+        // Any order with children before parents works for the heights
+        std::vector<int> stack = {0};
+        std::vector<int> preorder;
+        while (!stack.empty())
+        {
+            int node = stack.back();
+            stack.pop_back();
+            preorder.push_back(node);
+            if (veb.inner(node))
+            {
+                stack.push_back(children[node][0]);
+                stack.push_back(children[node][1]);
+            }
+        }
+        for (auto it = preorder.rbegin(); it != preorder.rend(); ++it)
+        {
+            if (veb.inner(*it))
+                veb.height[*it] = 1 + std::max(veb.height[children[*it][0]],
+                                               veb.height[children[*it][1]]);
+        }
+
+        veb.layout(0, veb.height[0]);
+        return order;
+    }
+
+    std::vector<int> stack = {0};
+    while (!stack.empty())
+    {
+        int node = stack.back();
+        stack.pop_back();
+        if (children[node][0] < 0)
+            continue;
+        order.push_back(node);
+
+        auto [first, second] = children[node];
+        if (layout == node_layout::dfs && weight[second] > weight[first])
+            std::swap(first, second);
+        stack.push_back(second);
+        stack.push_back(first);
+    }
+    return order;
+}
@@ -0,0 +1,44 @@
+// Ray tracing with a cone tree
+// Copyright © 2022 otreblan
+//
+// cone-tree is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// cone-tree is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with cone-tree.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#pragma once
+
+#include <array>
+#include <string_view>
+#include <vector>
+
+// Order of the nodes of a frozen binary tree in memory. Both trees store the two children of a
+// node next to each other, so a layout is the order in which those sibling pairs are written.
+//
+// build: whatever order the builder left them in.
+// dfs:   depth first, the child with the bigger surface area (the likelier one) first, so the
+//        usual descent reads memory forwards.
+// veb:   van Emde Boas, the tree is cut at half its height and the top and every bottom subtree
+//        are laid out recursively, which keeps any path in few cache lines whatever their size.
+enum class node_layout
+{
+    build,
+    dfs,
+    veb,
+};
+
+node_layout parse_node_layout(std::string_view name);
+
+// Inner nodes in the order their children pairs should be stored, parents before children.
+// Node 0 is the root, children holds -1 for leaves and weight picks the first child for dfs.
+std::vector<int> pair_order(node_layout layout, const std::vector<std::array<int, 2>>& children,
+                            const std::vector<float>& weight);
@@ -14,104 +14,594 @@
 // You should have received a copy of the GNU General Public License
 // along with cone-tree.  If not, see <http://www.gnu.org/licenses/>.
 
+#include <algorithm>
 #include <cmath>
+#include <cstdio>
+#include <getopt.h>
+#include <string>
+#include <thread>
 #include <unistd.h>
 
 #include <fmt/core.h>
-#include <glm/geometric.hpp>
-#include <glm/gtx/compatibility.hpp>
 #include <glm/vec3.hpp>
 
-#include "rtx/rtweekend.hpp"
 #include "rtx/camera.hpp"
-#include "rtx/ray.hpp"
 
-#include "scene/scene_bvh.hpp"
-#include "scene/scene_list.hpp"
-#include "scene/scene_kd6.hpp"
+#include "render/batch.hpp"
+#include "render/denoise.hpp"
+#include "render/distributed.hpp"
+#include "render/heatmap.hpp"
+#include "render/image_output.hpp"
+#include "render/job.hpp"
+#include "render/render.hpp"
+#include "render/server.hpp"
+#include "render/wavefront.hpp"
+
+#include "scene/scene_factory.hpp"
+#include "scene/scene_ooc.hpp"
 
 #include "loader.hpp"
-#include "print.hpp"
+#include "stats.hpp"
 #include "timer.hpp"
+#include "tune.hpp"
 
-
-glm::vec3 ray_color(const ray& r, const scene& world, int depth)
+enum long_only_options
 {
-    hit_record rec;
+    OPT_PREVIEW_INTERVAL = 256,
+    OPT_THRESHOLD,
+    OPT_MIN_SAMPLES,
+    OPT_MAX_SAMPLES,
+    OPT_SORT_RAYS,
+    OPT_ROULETTE_DEPTH,
+    OPT_TREELET_ROUNDS,
+    OPT_LAYOUT,
+    OPT_AUTOTUNE,
+    OPT_LAZY,
+    OPT_CLUSTER_SIZE,
+    OPT_MEMORY_BUDGET,
+    OPT_CLUSTER_DIR,
+    OPT_WORKERS,
+    OPT_LISTEN,
+    OPT_CONNECT,
+    OPT_SERVE,
+    OPT_VIEWS,
+    OPT_THREADS,
+    OPT_SAMPLER,
+    OPT_DENOISE,
+};
 
-    if (depth <= 0)
-        return glm::vec3(0.f);
+static void usage(const char* argv0)
+{
+    fmt::print(stderr,
+               "Usage: {} [OPTION]... <scene.sce>\n"
+               "Render a scene to stdout.\n\n"
+               "  -s, --scene=BACKEND        acceleration structure: list, bvh, qbvh, kd6, ooc\n"
+               "                             or split (default: kd6)\n"
+               "      --treelet-rounds=N     optimize bvh and qbvh treelets N times (default: 0)\n"
+               "      --layout=LAYOUT        bvh, kd6 and split node order: build, dfs or veb\n"
+               "                             (default: build)\n"
+               "      --lazy                 bvh: split nodes when rays first reach them\n"
+               "      --cluster-size=N       ooc: primitives per cluster on disk (default: 1024)\n"
+               "      --memory-budget=MIB    ooc: clusters kept mapped at once (default: 256)\n"
+               "      --cluster-dir=DIR      ooc: where to write the clusters (default: $TMPDIR)\n"
+               "      --autotune             time several build constants on this scene and save\n"
+               "                             the fastest next to it, in <scene.sce>.tune\n"
+               "  -n, --samples=N            samples per pixel (default: 50)\n"
+               "      --roulette-depth=N     bounces before Russian roulette, 50 disables it\n"
+               "                             (default: 3)\n"
+               "      --sampler=SAMPLER      random numbers for the paths: random, stratified,\n"
+               "                             halton or sobol (default: random)\n"
+               "      --denoise              filter the noise out of the image, guided by the\n"
+               "                             albedo, normal and depth of the first hits\n"
+               "  -f, --format=FORMAT        image format: p3, p6, pfm or exr (default: p6)\n"
+               "  -o, --output=FILE          write the image to FILE instead of stdout\n"
+               "  -H, --heatmap=FILE         also write the traversal cost of the primary rays\n"
+               "  -p, --progressive          render one sample per pixel per pass\n"
+               "  -t, --time-budget=SECS     stop a progressive render after this long\n"
+               "  -P, --preview=FILE         keep FILE updated with the progressive render\n"
+               "      --preview-interval=SECS  time between previews (default: 1)\n"
+               "  -a, --adaptive             stop sampling pixels once they converge\n"
+               "      --threshold=E          adaptive error threshold (default: 0.01)\n"
+               "      --min-samples=N        adaptive samples before checking (default: 8)\n"
+               "      --max-samples=N        adaptive samples cap (default: 4 * samples)\n"
+               "  -w, --wavefront            trace all paths one bounce at a time\n"
+               "      --sort-rays            sort wavefront bounces by origin and direction\n"
+               "      --workers=N            render in N worker processes\n"
+               "      --listen=ADDR          also take workers that connect to ADDR, unix:PATH\n"
+               "                             or HOST:PORT\n"
+               "      --connect=ADDR         be a worker of the render listening on ADDR\n"
+               "      --views=FILE           render every view in FILE, one per line: the output\n"
+               "                             file and the keys of a --serve job\n"
+               "      --threads=N            threads for --views and --denoise (default: every\n"
+               "                             core)\n"
+               "      --serve[=ADDR]         keep the scene loaded and render the jobs read from\n"
+               "                             ADDR, or stdin, answering to the same place\n"
+               "  -h, --help                 show this help\n",
+               argv0);
+}
 
-    if (world.hit(r, 0.001f, HUGE_VALF, rec))
+// Sums over samples samples per pixel to denoised averages
+static void denoise_sums(std::vector<glm::vec3>& image, guide_image& guides, float samples,
+                         const render_settings& settings, int threads)
+{
+    for (std::size_t idx = 0; idx < image.size(); ++idx)
     {
-        ray scattered;
-        glm::vec3 attenuation;
-
-        if (rec.mat_ptr && rec.mat_ptr->scatter(r, rec, attenuation, scattered))
-            return attenuation * ray_color(scattered, world, depth - 1);
-
-        return glm::vec3(0.f);
+        image[idx] /= samples;
+        guides.divide(idx, samples);
     }
+    denoise(image, guides, settings.width, settings.height, denoise_settings(), threads);
+}
 
-    glm::vec3 unit_direction = glm::normalize(r.direction);
-    float t = 0.5f * (unit_direction.y + 1.f);
-    return glm::lerp(glm::vec3(1.f, 1.f, 1.f), glm::vec3(0.5f, 0.7f, 1.f), t);
+// Written to a temporary file first so viewers never see half an image. Denoised when given the
+// guides.
+static void write_preview(const char* path, image_format format, const std::vector<glm::vec3>& image,
+                          const render_settings& settings, int passes, const guide_image* guides,
+                          int threads)
+{
+    std::string tmp = std::string(path) + ".tmp";
+    std::FILE* file = std::fopen(tmp.c_str(), "wb");
+    if (!file)
+    {
+        fmt::print(stderr, "Failed to open {}\n", tmp);
+        return;
+    }
+    if (guides)
+    {
+        std::vector<glm::vec3> denoised = image;
+        guide_image averages = *guides;
+        denoise_sums(denoised, averages, (float)passes, settings, threads);
+        write_image(file, format, denoised, settings.width, settings.height, 1.f);
+    }
+    else
+        write_image(file, format, image, settings.width, settings.height, 1.f / passes);
+    std::fclose(file);
+    std::rename(tmp.c_str(), path);
 }
 
 int main(int argc, char* argv[])
 {
-    if (argc < 2)
+    std::string backend = "kd6";
+    scene_options scene_opts;
+    image_format format = image_format::p6;
+    const char* output_file = nullptr;
+    const char* heatmap_file = nullptr;
+    const char* preview_file = nullptr;
+    bool progressive = false;
+    bool adaptive = false;
+    bool wavefront = false;
+    bool tune = false;
+    bool denoising = false;
+    wavefront_settings wavefront_opts;
+    distributed_settings distributed_opts;
+    const char* connect_address = nullptr;
+    bool serving = false;
+    std::string serve_address; // Empty for stdin and stdout
+    const char* views_file = nullptr;
+    int threads = (int)std::max(1u, std::thread::hardware_concurrency());
+    adaptive_settings adaptive_opts;
+    double time_budget = 0;
+    double preview_interval = 1;
+
+    // Image
+    render_settings settings;
+    const float aspect_ratio = 16.f / 9.f;
+    settings.width = 800;
+    settings.height = (float)settings.width / aspect_ratio;
+
+    const option long_options[] = {
+        {"scene", required_argument, nullptr, 's'},
+        {"treelet-rounds", required_argument, nullptr, OPT_TREELET_ROUNDS},
+        {"layout", required_argument, nullptr, OPT_LAYOUT},
+        {"lazy", no_argument, nullptr, OPT_LAZY},
+        {"cluster-size", required_argument, nullptr, OPT_CLUSTER_SIZE},
+        {"memory-budget", required_argument, nullptr, OPT_MEMORY_BUDGET},
+        {"cluster-dir", required_argument, nullptr, OPT_CLUSTER_DIR},
+        {"autotune", no_argument, nullptr, OPT_AUTOTUNE},
+        {"samples", required_argument, nullptr, 'n'},
+        {"roulette-depth", required_argument, nullptr, OPT_ROULETTE_DEPTH},
+        {"sampler", required_argument, nullptr, OPT_SAMPLER},
+        {"denoise", no_argument, nullptr, OPT_DENOISE},
+        {"format", required_argument, nullptr, 'f'},
+        {"output", required_argument, nullptr, 'o'},
+        {"heatmap", required_argument, nullptr, 'H'},
+        {"progressive", no_argument, nullptr, 'p'},
+        {"time-budget", required_argument, nullptr, 't'},
+        {"preview", required_argument, nullptr, 'P'},
+        {"preview-interval", required_argument, nullptr, OPT_PREVIEW_INTERVAL},
+        {"adaptive", no_argument, nullptr, 'a'},
+        {"threshold", required_argument, nullptr, OPT_THRESHOLD},
+        {"min-samples", required_argument, nullptr, OPT_MIN_SAMPLES},
+        {"max-samples", required_argument, nullptr, OPT_MAX_SAMPLES},
+        {"wavefront", no_argument, nullptr, 'w'},
+        {"sort-rays", no_argument, nullptr, OPT_SORT_RAYS},
+        {"workers", required_argument, nullptr, OPT_WORKERS},
+        {"listen", required_argument, nullptr, OPT_LISTEN},
+        {"connect", required_argument, nullptr, OPT_CONNECT},
+        {"serve", optional_argument, nullptr, OPT_SERVE},
+        {"views", required_argument, nullptr, OPT_VIEWS},
+        {"threads", required_argument, nullptr, OPT_THREADS},
+        {"help", no_argument, nullptr, 'h'},
+        {nullptr, 0, nullptr, 0},
+    };
+
+    int c;
+    while ((c = getopt_long(argc, argv, "s:n:f:o:H:pt:P:awh", long_options, nullptr)) != -1)
+    {
+        switch (c)
+        {
+            case 's':
+                backend = optarg;
+                break;
+            case OPT_TREELET_ROUNDS:
+                scene_opts.treelet_rounds = std::stoi(optarg);
+                break;
+            case OPT_LAYOUT:
+                scene_opts.layout = parse_node_layout(optarg);
+                break;
+            case OPT_LAZY:
+                scene_opts.lazy = true;
+                break;
+            case OPT_CLUSTER_SIZE:
+                scene_opts.cluster_size = std::stoul(optarg);
+                break;
+            case OPT_MEMORY_BUDGET:
+                scene_opts.memory_budget = std::stoul(optarg) << 20;
+                break;
+            case OPT_CLUSTER_DIR:
+                scene_opts.cluster_dir = optarg;
+                break;
+            case OPT_AUTOTUNE:
+                tune = true;
+                break;
+            case 'n':
+                settings.samples_per_pixel = std::stoi(optarg);
+                break;
+            case OPT_ROULETTE_DEPTH:
+                settings.roulette_depth = std::stoi(optarg);
+                break;
+            case OPT_SAMPLER:
+                settings.sampler = parse_sampler_type(optarg);
+                break;
+            case OPT_DENOISE:
+                denoising = true;
+                break;
+            case 'f':
+                format = parse_image_format(optarg);
+                break;
+            case 'o':
+                output_file = optarg;
+                break;
+            case 'H':
+                heatmap_file = optarg;
+                break;
+            case 'p':
+                progressive = true;
+                break;
+            case 't':
+                time_budget = std::stod(optarg);
+                break;
+            case 'P':
+                preview_file = optarg;
+                break;
+            case OPT_PREVIEW_INTERVAL:
+                preview_interval = std::stod(optarg);
+                break;
+            case 'a':
+                adaptive = true;
+                break;
+            case OPT_THRESHOLD:
+                adaptive_opts.threshold = std::stof(optarg);
+                break;
+            case OPT_MIN_SAMPLES:
+                adaptive_opts.min_samples = std::stoi(optarg);
+                break;
+            case OPT_MAX_SAMPLES:
+                adaptive_opts.max_samples = std::stoi(optarg);
+                break;
+            case 'w':
+                wavefront = true;
+                break;
+            case OPT_SORT_RAYS:
+                wavefront_opts.sort_secondary = true;
+                break;
+            case OPT_WORKERS:
+                distributed_opts.local_workers = std::stoi(optarg);
+                break;
+            case OPT_LISTEN:
+                distributed_opts.listen = optarg;
+                break;
+            case OPT_CONNECT:
+                connect_address = optarg;
+                break;
+            case OPT_SERVE:
+                serving = true;
+                serve_address = optarg ? optarg : "";
+                break;
+            case OPT_VIEWS:
+                views_file = optarg;
+                break;
+            case OPT_THREADS:
+                threads = std::stoi(optarg);
+                break;
+            case 'h':
+                usage(argv[0]);
+                return EXIT_SUCCESS;
+            default:
+                usage(argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+
+    if (optind >= argc || settings.samples_per_pixel < 1)
+    {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    if ((time_budget > 0 || preview_file) && !progressive)
+    {
+        fmt::print(stderr, "--time-budget and --preview need --progressive\n");
+        return EXIT_FAILURE;
+    }
+
+    if (wavefront_opts.sort_secondary && !wavefront)
+    {
+        fmt::print(stderr, "--sort-rays needs --wavefront\n");
+        return EXIT_FAILURE;
+    }
+
+    const bool distributed = distributed_opts.local_workers > 0 || !distributed_opts.listen.empty();
+    if ((int)adaptive + (int)progressive + (int)wavefront + (int)distributed +
+            (int)(connect_address != nullptr) + (int)serving + (int)(views_file != nullptr) >
+        1)
+    {
+        fmt::print(stderr, "Only one of --adaptive, --progressive, --wavefront, --workers or "
+                           "--listen, --connect, --serve and --views can be used\n");
+        return EXIT_FAILURE;
+    }
+
+    // The other modes never hold the whole image with its guides in this process
+    if (denoising && (wavefront || distributed || connect_address || serving || views_file))
+    {
+        fmt::print(stderr, "--denoise can't be used with --wavefront, --workers, --listen, "
+                           "--connect, --serve or --views\n");
+        return EXIT_FAILURE;
+    }
+
+    if (heatmap_file && !traversal_stats_enabled)
+    {
+        fmt::print(stderr, "--heatmap needs a build with -DCONE_TREE_STATS=ON\n");
+        return EXIT_FAILURE;
+    }
+
+    // Workers send their samples to the coordinator, servers answer their clients and views
+    // name their own files instead
+    const bool single_image = !connect_address && !serving && !views_file;
+    std::FILE* output = stdout;
+    if (output_file && single_image)
+    {
+        output = std::fopen(output_file, "wb");
+        if (!output)
+        {
+            fmt::print(stderr, "Failed to open {}\n", output_file);
+            return EXIT_FAILURE;
+        }
+    }
+    else if (single_image && is_binary(format) && isatty(STDOUT_FILENO))
+    {
+        fmt::print(stderr, "Refusing to write a binary image to a terminal, use --output\n");
+        return EXIT_FAILURE;
+    }
+
+    // Also what a server or a view renders when it leaves something out
+    render_job job;
+    job.settings = settings;
+    job.format = format;
+    camera cam = job.make_camera();
+
+    std::vector<batch_view> views;
+    if (views_file)
     {
-        fmt::print(stderr, "Usage: {} <scene.sce>", argv[0]);
-        return 1;
+        views = read_views(views_file, job);
+        if (views.empty())
+        {
+            fmt::print(stderr, "No views in {}\n", views_file);
+            return EXIT_FAILURE;
+        }
+    }
+
+    // Build constants, tuned now or saved by an earlier --autotune
+    const std::string tune_file = tune_path(argv[optind]);
+    if (tune)
+    {
+        auto build = [&](const scene_options& options)
+        {
+            auto world = make_scene(backend, options);
+            load_scene(argv[optind], *world);
+            world->freeze();
+            return world;
+        };
+        auto result = autotune(backend, scene_opts, build, cam);
+        write_tune(tune_file, backend, result.best);
+        scene_opts.sah = result.best;
+        fmt::print(stderr, "Tuned in {} builds: {:.2f}ms to {:.2f}ms, saved to {}\n",
+                   result.builds, 1000 * result.initial_s, 1000 * result.best_s, tune_file);
+    }
+    else if (read_tune(tune_file, backend, scene_opts.sah))
+    {
+        fmt::print(stderr, "Build constants from {}\n", tune_file);
     }
-    bool stdout_tty = isatty(STDOUT_FILENO);
 
     // World
-    scene_kd6 world;
-    load_scene(argv[1], world);
+    auto world_ptr = make_scene(backend, scene_opts);
+    scene& world = *world_ptr;
+    load_scene(argv[optind], world);
 
     Timer timer;
     timer.reset();
     world.freeze();
     fmt::print(stderr, "Freeze: {}s\n", timer.elapsed());
+    if constexpr (traversal_stats_enabled)
+        print_stats(stderr, world.stats());
 
-    // Image
-    const float aspect_ratio = 16.f / 9.f;
-    const int image_width = 800;
-    const int image_height = (float)image_width / aspect_ratio;
-    const int samples_per_pixel = 50;
-    const int max_depth = 50;
-//    camera cam = camera::pointing(glm::vec3(-1.f, 0.f, -2.f), glm::vec3(0.f, 0.f, 0.f),
-        camera cam = camera::pointing(glm::vec3(0, 0, 1), glm::vec3(0.f, 0.f, -1.f),
-                                  2 * glm::atan(1.f), aspect_ratio, 1.0f);
+    if (connect_address)
+    {
+        run_worker(world, connect_address);
+        return EXIT_SUCCESS;
+    }
 
-    fmt::print("P3\n{} {}\n255\n", image_width, image_height);
+    if (serving)
+    {
+        if (serve_address.empty())
+            serve_stream(world, job, STDIN_FILENO, STDOUT_FILENO);
+        else
+            serve(world, job, serve_address);
+        return EXIT_SUCCESS;
+    }
+
+    if (views_file)
+    {
+        std::vector<std::vector<glm::vec3>> images;
+        timer.reset();
+        auto stats = render_batch(world, views, threads, images);
+        double t = timer.elapsed();
+        fmt::print(stderr, "Elapsed time: {}ms, {} views in {} bands on {} threads\n", 1000 * t,
+                   views.size(), stats.bands, stats.threads);
+        fmt::print(stderr, "Rays: {} ({:.2f} per path)\n", stats.paths.rays,
+                   stats.paths.average_length());
 
-    std::vector<glm::vec3> image(image_width * image_height);
+        for (std::size_t v = 0; v < views.size(); v++)
+        {
+            const render_job& view = views[v].job;
+            std::FILE* file = std::fopen(views[v].output.c_str(), "wb");
+            if (!file)
+            {
+                fmt::print(stderr, "Failed to open {}\n", views[v].output);
+                return EXIT_FAILURE;
+            }
+            write_image(file, view.format, images[v], view.settings.width, view.settings.height,
+                        1.f / view.settings.samples_per_pixel);
+            std::fclose(file);
+        }
+        return EXIT_SUCCESS;
+    }
+
+    if (heatmap_file)
+    {
+        std::FILE* file = std::fopen(heatmap_file, "wb");
+        if (!file)
+        {
+            fmt::print(stderr, "Failed to open {}\n", heatmap_file);
+            return EXIT_FAILURE;
+        }
+        write_heatmap(file, render_heatmap(world, cam, settings.width, settings.height));
+        std::fclose(file);
+        reset_traversal_stats();
+    }
+
+    std::vector<glm::vec3> image(settings.width * settings.height);
+    float scale = 1.f / settings.samples_per_pixel;
+    path_stats paths;
+    guide_image guides;
+    if (denoising)
+        guides.assign(image.size());
+    guide_image* guides_ptr = denoising ? &guides : nullptr;
 
     timer.reset();
-    for (int j = image_height - 1; j >= 0; --j)
+    if (progressive)
     {
-        for (int i = 0; i < image_width; ++i)
+        Timer since_preview;
+        int passes = 0;
+        while (passes < settings.samples_per_pixel &&
+               !(time_budget > 0 && timer.elapsed() >= time_budget))
         {
-            for (int s = 0; s < samples_per_pixel; ++s)
+            paths += render_pass(world, cam, settings, passes, image, guides_ptr);
+            passes++;
+
+            if (preview_file && (passes == 1 || since_preview.elapsed() >= preview_interval))
             {
-                float u = (i + random_float()) / (image_width - 1);
-                float v = (j + random_float()) / (image_height - 1);
-                ray r = cam.get_ray(u, v);
-                image[i + j * image_width] += ray_color(r, world, max_depth);
+                write_preview(preview_file, format, image, settings, passes, guides_ptr, threads);
+                since_preview.reset();
             }
         }
+        scale = 1.f / passes;
+        fmt::print(stderr, "Passes: {}\n", passes);
+
+        if (preview_file)
+            write_preview(preview_file, format, image, settings, passes, guides_ptr, threads);
+    }
+    else if (adaptive)
+    {
+        std::vector<int> counts;
+        auto result =
+            render_adaptive(world, cam, settings, adaptive_opts, image, counts, guides_ptr);
+        paths = result.paths;
+
+        // Every pixel has its own sample count, resolve them here
+        for (std::size_t idx = 0; idx < image.size(); ++idx)
+        {
+            image[idx] /= (float)counts[idx];
+            if (denoising)
+                guides.divide(idx, (float)counts[idx]);
+        }
+        scale = 1.f;
+
+        auto saved = result.budget - result.samples;
+        fmt::print(stderr, "Samples: {} of {} ({} saved, {:.1f}%), {} to {} per pixel\n",
+                   result.samples, result.budget, saved, 100.0 * saved / result.budget,
+                   *std::min_element(counts.begin(), counts.end()),
+                   *std::max_element(counts.begin(), counts.end()));
+    }
+    else if (wavefront)
+    {
+        auto stats = render_wavefront(world, cam, settings, wavefront_opts, image);
+        paths = stats.paths;
+        fmt::print(stderr,
+                   "Stages: generate {:.1f}ms, sort {:.1f}ms, extend {:.1f}ms, shade {:.1f}ms, "
+                   "connect {:.1f}ms\n",
+                   1000 * stats.generate, 1000 * stats.sort, 1000 * stats.extend,
+                   1000 * stats.shade, 1000 * stats.connect);
+    }
+    else if (distributed)
+    {
+        auto stats = render_distributed(world, cam, settings, distributed_opts, image);
+        paths = stats.paths;
+        fmt::print(stderr, "Workers: {}, {} bands, {} handed out again\n", stats.workers,
+                   stats.units, stats.retried);
+    }
+    else
+    {
+        paths = render(world, cam, settings, image, guides_ptr);
     }
 
     double t = timer.elapsed();
     fmt::print(stderr, "Elapsed time: {}ms\n", 1000.f * t);
-    for (int j = image_height - 1; j >= 0; --j) {
-        for (int i = 0; i < image_width; ++i) {
-            fmt::print("{}\n", sampled_color(image[i + j * image_width], samples_per_pixel));
-        }
+    fmt::print(stderr, "Rays: {} ({:.2f} per path)\n", paths.rays, paths.average_length());
+    if constexpr (traversal_stats_enabled)
+        print_stats(stderr, collect_traversal_stats());
+    if (auto* ooc = dynamic_cast<const scene_ooc*>(&world))
+    {
+        auto paging = ooc->paging();
+        fmt::print(stderr,
+                   "Clusters: {} ({:.1f}MiB on disk), {} loads, {} evictions, {:.1f}MiB peak\n",
+                   paging.clusters, paging.file_bytes / 1048576.0, paging.loads, paging.evictions,
+                   paging.peak_bytes / 1048576.0);
     }
 
+    if (denoising)
+    {
+        timer.reset();
+        denoise_sums(image, guides, 1.f / scale, settings, threads);
+        scale = 1.f;
+        fmt::print(stderr, "Denoise: {}ms\n", 1000.f * timer.elapsed());
+    }
+
+    timer.reset();
+    write_image(output, format, image, settings.width, settings.height, scale);
+    fmt::print(stderr, "Output: {}ms\n", 1000.f * timer.elapsed());
+
+    if (output != stdout)
+        std::fclose(output);
+
     return EXIT_SUCCESS;
 }
@@ -1,31 +1,52 @@
-// Ray tracing with a cone tree
-// Copyright © 2022 otreblan
-//
-// cone-tree is free software: you can redistribute it and/or modify
-// it under the terms of the GNU General Public License as published by
-// the Free Software Foundation, either version 3 of the License, or
-// (at your option) any later version.
-//
-// cone-tree is distributed in the hope that it will be useful,
-// but WITHOUT ANY WARRANTY; without even the implied warranty of
-// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
-// GNU General Public License for more details.
-//
-// You should have received a copy of the GNU General Public License
-// along with cone-tree.  If not, see <http://www.gnu.org/licenses/>.
-
-#pragma once
-
-#include <glm/vec3.hpp>
-
-#include "../rtx/rtweekend.hpp"
-
-struct hit_record;
-struct ray;
-
-class material
-{
-public:
-    virtual bool scatter(const ray& r_in, const hit_record& rec, glm::vec3& attenutation,
-                         ray& scattered) const = 0;
-};
+// Ray tracing with a cone tree
+// Copyright © 2022 otreblan
+//
+// cone-tree is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// cone-tree is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with cone-tree.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#pragma once
+
+#include <cstdint>
+#include <variant>
+#include <vector>
+
+#include <glm/vec3.hpp>
+
+#include "lambertian.hpp"
+#include "metal.hpp"
+
+// Materials are plain structs in a tagged union, the scene keeps all of them in one table and
+// hits refer to them by index. Adding one means adding it to the variant.
+using material = std::variant<lambertian, metal>;
+using material_table = std::vector<material>;
+
+inline bool scatter(const material& mat, const ray& r_in, const hit_record& rec,
+                    sample_stream& samples, glm::vec3& attenutation, ray& scattered)
+{
+    return std::visit([&](const auto& m)
+                      { return m.scatter(r_in, rec, samples, attenutation, scattered); },
+                      mat);
+}
+
+// Fraction of the light the material reflects, what the denoiser keeps apart from the lighting
+inline glm::vec3 albedo(const material& mat)
+{
+    return std::visit([](const auto& m) { return m.albedo; }, mat);
+}
+
+// Whether it shows what it reflects, the denoiser then takes its guides from that instead
+inline bool is_specular(const material& mat)
+{
+    return std::visit([](const auto& m) { return m.specular(); }, mat);
+}
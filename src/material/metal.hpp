@@ -1,43 +1,48 @@
-// Ray tracing with a cone tree
-// Copyright © 2022 otreblan
-//
-// cone-tree is free software: you can redistribute it and/or modify
-// it under the terms of the GNU General Public License as published by
-// the Free Software Foundation, either version 3 of the License, or
-// (at your option) any later version.
-//
-// cone-tree is distributed in the hope that it will be useful,
-// but WITHOUT ANY WARRANTY; without even the implied warranty of
-// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
-// GNU General Public License for more details.
-//
-// You should have received a copy of the GNU General Public License
-// along with cone-tree.  If not, see <http://www.gnu.org/licenses/>.
-
-#pragma once
-
-#include "../object/hittable.hpp"
-#include "../rtx/camera.hpp"
-#include "../rtx/ray.hpp"
-#include "material.hpp"
-
-#include <glm/vec3.hpp>
-
-class metal : public material
-{
-public:
-    glm::vec3 albedo;
-    float fuzz;
-
-    metal(glm::vec3 albedo, float f) : albedo(std::move(albedo)), fuzz(std::min(f, 1.f)){};
-
-    virtual bool scatter(const ray& r_in, const hit_record& rec, glm::vec3& attenutation,
-                         ray& scattered) const override
-    {
-        glm::vec3 reflected = glm::reflect(glm::normalize(r_in.direction), rec.normal);
-        scattered = ray(rec.p, reflected + fuzz * glm::ballRand(1.f));
-        attenutation = albedo;
-
-        return glm::dot(scattered.direction, rec.normal) > 0.f;
-    }
-};
+// Ray tracing with a cone tree
+// Copyright © 2022 otreblan
+//
+// cone-tree is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// cone-tree is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with cone-tree.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#pragma once
+
+#include <glm/geometric.hpp>
+#include <glm/vec3.hpp>
+
+#include "../rtx/hit_record.hpp"
+#include "../rtx/ray.hpp"
+#include "../rtx/rtweekend.hpp"
+#include "../rtx/sampler.hpp"
+
+struct metal
+{
+    glm::vec3 albedo;
+    float fuzz; // At most 1
+
+    // Rougher ones scatter too much for what they reflect to be recognizable
+    [[nodiscard]] bool specular() const { return fuzz <= 0.1f; }
+
+    bool scatter(const ray& r_in, const hit_record& rec, sample_stream& samples,
+                 glm::vec3& attenutation, ray& scattered) const
+    {
+        float u1 = samples.next();
+        float u2 = samples.next();
+        float u3 = samples.next();
+        glm::vec3 reflected = glm::reflect(glm::normalize(r_in.direction), rec.normal);
+        scattered = ray(rec.p, reflected + fuzz * in_unit_ball(u1, u2, u3));
+        attenutation = albedo;
+
+        return glm::dot(scattered.direction, rec.normal) > 0.f;
+    }
+};
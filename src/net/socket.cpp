@@ -0,0 +1,213 @@
+// Ray tracing with a cone tree
+// Copyright © 2022 otreblan
+//
+// cone-tree is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// cone-tree is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with cone-tree.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "socket.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+static std::runtime_error socket_error(const std::string& what)
+{
+    return std::runtime_error(what + ": " + std::strerror(errno));
+}
+
+static bool is_unix(const std::string& address) { return address.rfind("unix:", 0) == 0; }
+
+static sockaddr_un unix_address(const std::string& address)
+{
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    std::string path = address.substr(5);
+    if (path.empty() || path.size() >= sizeof(addr.sun_path))
+        throw std::runtime_error("Bad Unix socket path: \"" + path + "\"");
+    std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+    return addr;
+}
+
+// Resolves "HOST:PORT", the host may be empty for every interface
+static addrinfo* tcp_address(const std::string& address, bool passive)
+{
+    auto colon = address.rfind(':');
+    if (colon == std::string::npos)
+        throw std::runtime_error("Addresses are unix:PATH or HOST:PORT, got \"" + address + "\"");
+    std::string host = address.substr(0, colon), port = address.substr(colon + 1);
+
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = passive ? AI_PASSIVE : 0;
+    addrinfo* result = nullptr;
+    int error = getaddrinfo(host.empty() ? nullptr : host.c_str(), port.c_str(), &hints, &result);
+    if (error != 0)
+        throw std::runtime_error("Failed to resolve " + address + ": " + gai_strerror(error));
+    return result;
+}
+
+// Results are small and latency bound, don't let Nagle hold them back
+static void set_nodelay(int fd)
+{
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+}
+
+int listen_on(const std::string& address, std::string& bound)
+{
+    if (is_unix(address))
+    {
+        sockaddr_un addr = unix_address(address);
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0)
+            throw socket_error("Failed to create a socket");
+        unlink(addr.sun_path);
+        if (bind(fd, (sockaddr*)&addr, sizeof(addr)) != 0 || listen(fd, 64) != 0)
+        {
+            close(fd);
+            throw socket_error("Failed to listen on " + address);
+        }
+        bound = address;
+        return fd;
+    }
+
+    addrinfo* list = tcp_address(address, true);
+    int fd = -1;
+    for (addrinfo* ai = list; ai && fd < 0; ai = ai->ai_next)
+    {
+        fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd < 0)
+            continue;
+        int one = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if (bind(fd, ai->ai_addr, ai->ai_addrlen) != 0 || listen(fd, 64) != 0)
+        {
+            close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(list);
+    if (fd < 0)
+        throw socket_error("Failed to listen on " + address);
+
+    sockaddr_storage addr{};
+    socklen_t length = sizeof(addr);
+    getsockname(fd, (sockaddr*)&addr, &length);
+    char host[NI_MAXHOST], port[NI_MAXSERV];
+    getnameinfo((sockaddr*)&addr, length, host, sizeof(host), port, sizeof(port),
+                NI_NUMERICHOST | NI_NUMERICSERV);
+    bound = address.substr(0, address.rfind(':')) + ":" + port;
+    return fd;
+}
+
+int connect_to(const std::string& address)
+{
+    if (is_unix(address))
+    {
+        sockaddr_un addr = unix_address(address);
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0)
+            throw socket_error("Failed to create a socket");
+        if (connect(fd, (sockaddr*)&addr, sizeof(addr)) != 0)
+        {
+            close(fd);
+            throw socket_error("Failed to connect to " + address);
+        }
+        return fd;
+    }
+
+    addrinfo* list = tcp_address(address, false);
+    int fd = -1;
+    for (addrinfo* ai = list; ai && fd < 0; ai = ai->ai_next)
+    {
+        fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd >= 0 && connect(fd, ai->ai_addr, ai->ai_addrlen) != 0)
+        {
+            close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(list);
+    if (fd < 0)
+        throw socket_error("Failed to connect to " + address);
+    set_nodelay(fd);
+    return fd;
+}
+
+int accept_from(int listener)
+{
+    int fd;
+    do
+        fd = accept(listener, nullptr, nullptr);
+    while (fd < 0 && errno == EINTR);
+    if (fd < 0)
+        throw socket_error("Failed to accept a connection");
+
+    sockaddr_storage addr{};
+    socklen_t length = sizeof(addr);
+    if (getsockname(fd, (sockaddr*)&addr, &length) == 0 && addr.ss_family != AF_UNIX)
+        set_nodelay(fd);
+    return fd;
+}
+
+void send_all(int fd, const void* data, std::size_t bytes)
+{
+    const auto* next = static_cast<const char*>(data);
+    while (bytes > 0)
+    {
+        // A peer that went away is an error here, not a SIGPIPE
+        ssize_t sent = send(fd, next, bytes, MSG_NOSIGNAL);
+        if (sent < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            throw socket_error("Failed to send");
+        }
+        next += sent;
+        bytes -= sent;
+    }
+}
+
+bool receive_all(int fd, void* data, std::size_t bytes)
+{
+    auto* next = static_cast<char*>(data);
+    const std::size_t total = bytes;
+    while (bytes > 0)
+    {
+        ssize_t received = recv(fd, next, bytes, 0);
+        if (received < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            throw socket_error("Failed to receive");
+        }
+        if (received == 0)
+        {
+            if (bytes == total)
+                return false;
+            throw std::runtime_error("Connection closed in the middle of a message");
+        }
+        next += received;
+        bytes -= received;
+    }
+    return true;
+}
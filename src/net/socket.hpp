@@ -0,0 +1,33 @@
+// Ray tracing with a cone tree
+// Copyright © 2022 otreblan
+//
+// cone-tree is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// cone-tree is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with cone-tree.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+// Blocking stream sockets. Addresses are "unix:PATH" for a Unix socket or "HOST:PORT" for TCP,
+// errors are thrown as std::runtime_error.
+
+// bound receives the address that was actually bound, with the port filled in when it was 0
+int listen_on(const std::string& address, std::string& bound);
+int connect_to(const std::string& address);
+int accept_from(int listener);
+
+void send_all(int fd, const void* data, std::size_t bytes);
+// False if the peer closed the connection before the first byte, throws if it did halfway
+bool receive_all(int fd, void* data, std::size_t bytes);
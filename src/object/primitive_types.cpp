@@ -0,0 +1,37 @@
+// Ray tracing with a cone tree
+// Copyright © 2022 otreblan
+//
+// cone-tree is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// cone-tree is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with cone-tree.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "primitive_types.hpp"
+
+#include "sphere.hpp"
+#include "triangle.hpp"
+
+void primitive_types::add(const hittable* object) noexcept
+{
+    if (dynamic_cast<const sphere*>(object))
+        mask |= spheres;
+    else if (dynamic_cast<const triangle*>(object))
+        mask |= triangles;
+    else if (object)
+        mask |= others;
+}
+
+void primitive_types::add(const std::vector<std::unique_ptr<hittable>>& objects) noexcept
+{
+    for (const auto& object : objects)
+        add(object.get());
+}
@@ -0,0 +1,74 @@
+// Ray tracing with a cone tree
+// Copyright © 2022 otreblan
+//
+// cone-tree is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// cone-tree is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with cone-tree.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "hittable.hpp"
+
+// The concrete types among the objects of a tree. Trees compile their traversal for each type
+// their leaves can cast objects to and pick one per ray: triangle when there is nothing else to
+// test, so triangle::hit() is a direct call inlined in the leaf loop, or hittable otherwise.
+class primitive_types
+{
+public:
+    void clear() noexcept { mask = 0; }
+    void add(const hittable* object) noexcept;
+    void add(const std::vector<std::unique_ptr<hittable>>& objects) noexcept;
+
+    // Whether every object is a triangle, leaving out spheres when the tree tests them from its
+    // sphere_store
+    [[nodiscard]] bool only_triangles(bool without_spheres) const noexcept
+    {
+        const unsigned rest = without_spheres ? mask & ~spheres : mask;
+        return (rest & ~triangles) == 0;
+    }
+
+private:
+    enum : std::uint8_t
+    {
+        spheres = 1,
+        triangles = 2,
+        others = 4,
+    };
+    std::uint8_t mask = 0;
+};
+
+// Closest hit among objects[order[i]] for i in [0, count) within [t_min, t_max], shrinks t_max to
+// it. Every object must be a Primitive, removed ones are null.
+template <Hittable Primitive>
+bool hit_objects(const std::vector<std::unique_ptr<hittable>>& objects, const int* order,
+                 std::size_t count, const ray& r, float t_min, float& t_max, hit_record& rec)
+{
+    bool found = false;
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        hit_record temp;
+        const hittable* object = objects[order[i]].get();
+        if (object && static_cast<const Primitive*>(object)->hit(r, t_min, t_max, temp))
+        {
+            rec = temp;
+            t_max = temp.t;
+            found = true;
+        }
+    }
+    return found;
+}
@@ -1,36 +1,87 @@
-// Ray tracing with a cone tree
-// Copyright © 2022 otreblan
-//
-// cone-tree is free software: you can redistribute it and/or modify
-// it under the terms of the GNU General Public License as published by
-// the Free Software Foundation, either version 3 of the License, or
-// (at your option) any later version.
-//
-// cone-tree is distributed in the hope that it will be useful,
-// but WITHOUT ANY WARRANTY; without even the implied warranty of
-// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
-// GNU General Public License for more details.
-//
-// You should have received a copy of the GNU General Public License
-// along with cone-tree.  If not, see <http://www.gnu.org/licenses/>.
-
-#pragma once
-
-#include "hittable.hpp"
-
-class sphere : public hittable
-{
-public:
-    glm::vec3 center;
-    float radius;
-    std::shared_ptr<material> mat_ptr;
-
-    sphere(const glm::vec3& center, float radius, std::shared_ptr<material> m)
-        : center(center), radius(radius), mat_ptr(std::move(m)){};
-
-    bool hit(const ray& r, float t_min, float t_max, hit_record& rec) const override;
-    [[nodiscard]] glm::vec3 centroid() const override;
-    [[nodiscard]] AABB bounding_box() const override;
-
-    ~sphere() override = default;
-};
+// Ray tracing with a cone tree
+// Copyright © 2022 otreblan
+//
+// cone-tree is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// cone-tree is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with cone-tree.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <cmath>
+
+#include <glm/geometric.hpp>
+#include <glm/gtx/compatibility.hpp>
+
+#include "hittable.hpp"
+
+// Final, and hit() defined here, so trees that know they hold spheres call it directly
+class sphere final : public hittable
+{
+public:
+    glm::vec3 center;
+    float radius;
+    material_id mat_id;
+
+    sphere(const glm::vec3& center, float radius, material_id m)
+        : center(center), radius(radius), mat_id(m){};
+
+    bool hit(const ray& r, float t_min, float t_max, hit_record& rec) const override;
+    [[nodiscard]] glm::vec3 centroid() const override;
+    // The test behind hit(), for spheres that aren't stored as objects
+    static bool intersect(const glm::vec3& center, float radius, material_id mat_id, const ray& r,
+                          float t_min, float t_max, hit_record& rec);
+    [[nodiscard]] AABB bounding_box() const override;
+
+    ~sphere() override = default;
+};
+
+inline bool sphere::hit(const ray& r, float t_min, float t_max, hit_record& rec) const
+{
+    return intersect(center, radius, mat_id, r, t_min, t_max, rec);
+}
+
+inline bool sphere::intersect(const glm::vec3& center, float radius, material_id mat_id,
+                              const ray& r, float t_min, float t_max, hit_record& rec)
+{
+    glm::vec3 oc = r.origin - center;
+
+    float a = glm::dot(r.direction, r.direction);
+    float half_b = glm::dot(oc, r.direction);
+    float c = glm::dot(oc, oc) - radius * radius;
+
+    float discriminant = half_b * half_b - a * c;
+
+    if (discriminant < 0.f)
+        return false;
+
+    float sqrtd = sqrtf(discriminant);
+
+    // Find the nearest root that lies in the acceptable range.
+    float root = (-half_b - sqrtd) / a;
+    if (root < t_min || t_max < root)
+    {
+        root = (-half_b + sqrtd) / a;
+        if (root < t_min || t_max < root)
+            return false;
+    }
+
+    rec.t = root;
+    rec.p = r.at(rec.t);
+
+    glm::vec3 outward_normal = (rec.p - center) / radius;
+
+    rec.normal = glm::faceforward(outward_normal, outward_normal, r.direction);
+    rec.front_face = rec.normal == outward_normal;
+    rec.mat_id = mat_id;
+
+    return true;
+}
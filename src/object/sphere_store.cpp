@@ -0,0 +1,245 @@
+// Ray tracing with a cone tree
+// Copyright © 2022 otreblan
+//
+// cone-tree is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// cone-tree is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with cone-tree.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "sphere_store.hpp"
+
+#include <cmath>
+#include <limits>
+
+#include <glm/geometric.hpp>
+#include <glm/gtx/compatibility.hpp>
+
+#include "sphere.hpp"
+#include "triangle.hpp"
+
+sphere_ray::sphere_ray(const ray& r) : r(r), a(glm::dot(r.direction, r.direction))
+{
+#ifdef __SSE2__
+    ox = _mm_set1_ps(r.origin.x);
+    oy = _mm_set1_ps(r.origin.y);
+    oz = _mm_set1_ps(r.origin.z);
+    dx = _mm_set1_ps(r.direction.x);
+    dy = _mm_set1_ps(r.direction.y);
+    dz = _mm_set1_ps(r.direction.z);
+    a4 = _mm_set1_ps(a);
+#endif
+}
+
+void sphere_store::build(const std::vector<std::unique_ptr<hittable>>& objects, const int* order,
+                         std::size_t count)
+{
+    clear();
+    bool any_sphere = false, only_spheres = true;
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        bool is_sphere = dynamic_cast<const sphere*>(objects[order[i]].get()) != nullptr;
+        any_sphere |= is_sphere;
+        only_spheres &= is_sphere;
+    }
+    if (!any_sphere)
+        return;
+
+    const float none = std::numeric_limits<float>::quiet_NaN();
+    x.assign(count, 0.f);
+    y.assign(count, 0.f);
+    z.assign(count, 0.f);
+    radius.assign(count, none);
+    mat_id.assign(count, 0);
+    if (!only_spheres)
+        others.assign(count, nullptr);
+
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        const hittable* object = objects[order[i]].get();
+        if (const auto* s = dynamic_cast<const sphere*>(object))
+        {
+            x[i] = s->center.x;
+            y[i] = s->center.y;
+            z[i] = s->center.z;
+            radius[i] = s->radius;
+            mat_id[i] = s->mat_id;
+        }
+        else
+        {
+            others[i] = object;
+        }
+    }
+}
+
+void sphere_store::assign(std::size_t slot, const hittable* object)
+{
+    const float none = std::numeric_limits<float>::quiet_NaN();
+    if (slot >= x.size())
+    {
+        x.resize(slot + 1, 0.f);
+        y.resize(slot + 1, 0.f);
+        z.resize(slot + 1, 0.f);
+        radius.resize(slot + 1, none);
+        mat_id.resize(slot + 1, 0);
+    }
+
+    const auto* s = dynamic_cast<const sphere*>(object);
+    if (object && !s && others.empty())
+        others.assign(mat_id.size(), nullptr);
+    if (!others.empty())
+    {
+        others.resize(mat_id.size(), nullptr);
+        others[slot] = s ? nullptr : object;
+    }
+
+    x[slot] = s ? s->center.x : 0.f;
+    y[slot] = s ? s->center.y : 0.f;
+    z[slot] = s ? s->center.z : 0.f;
+    radius[slot] = s ? s->radius : none;
+    mat_id[slot] = s ? s->mat_id : 0;
+}
+
+void sphere_store::clear() noexcept
+{
+    x.clear();
+    y.clear();
+    z.clear();
+    radius.clear();
+    mat_id.clear();
+    others.clear();
+}
+
+// Same arithmetic as sphere::hit(), in the same order, so both give the same hits
+void sphere_store::test(const sphere_ray& r, std::size_t first, float t_min, float t_max,
+                        float* t) const
+{
+#ifdef __SSE2__
+    const __m128 ocx = _mm_sub_ps(r.ox, _mm_loadu_ps(&x[first]));
+    const __m128 ocy = _mm_sub_ps(r.oy, _mm_loadu_ps(&y[first]));
+    const __m128 ocz = _mm_sub_ps(r.oz, _mm_loadu_ps(&z[first]));
+    const __m128 rad = _mm_loadu_ps(&radius[first]);
+
+    const __m128 half_b = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ocx, r.dx), _mm_mul_ps(ocy, r.dy)),
+                                     _mm_mul_ps(ocz, r.dz));
+    const __m128 oc2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ocx, ocx), _mm_mul_ps(ocy, ocy)),
+                                  _mm_mul_ps(ocz, ocz));
+    const __m128 c = _mm_sub_ps(oc2, _mm_mul_ps(rad, rad));
+    const __m128 discriminant = _mm_sub_ps(_mm_mul_ps(half_b, half_b), _mm_mul_ps(r.a4, c));
+
+    // A negative discriminant gives a NaN root, which fails every comparison below
+    const __m128 sqrtd = _mm_sqrt_ps(discriminant);
+    const __m128 neg_half_b = _mm_xor_ps(half_b, _mm_set1_ps(-0.f));
+    const __m128 near = _mm_div_ps(_mm_sub_ps(neg_half_b, sqrtd), r.a4);
+    const __m128 far = _mm_div_ps(_mm_add_ps(neg_half_b, sqrtd), r.a4);
+
+    const __m128 lo = _mm_set1_ps(t_min), hi = _mm_set1_ps(t_max);
+    const __m128 near_ok = _mm_and_ps(_mm_cmpge_ps(near, lo), _mm_cmple_ps(near, hi));
+    const __m128 far_ok = _mm_and_ps(_mm_cmpge_ps(far, lo), _mm_cmple_ps(far, hi));
+    const __m128 miss = _mm_set1_ps(std::numeric_limits<float>::quiet_NaN());
+
+    const __m128 other = _mm_or_ps(_mm_and_ps(far_ok, far), _mm_andnot_ps(far_ok, miss));
+    _mm_storeu_ps(t, _mm_or_ps(_mm_and_ps(near_ok, near), _mm_andnot_ps(near_ok, other)));
+#else
+    for (std::size_t l = 0; l < lanes; ++l)
+        t[l] = test(r, first + l, t_min, t_max);
+#endif
+}
+
+float sphere_store::test(const sphere_ray& r, std::size_t i, float t_min, float t_max) const
+{
+    const glm::vec3 oc = r.r.origin - glm::vec3(x[i], y[i], z[i]);
+    const float half_b = glm::dot(oc, r.r.direction);
+    const float c = glm::dot(oc, oc) - radius[i] * radius[i];
+    const float discriminant = half_b * half_b - r.a * c;
+
+    if (!(discriminant >= 0.f))
+        return std::numeric_limits<float>::quiet_NaN();
+    const float sqrtd = std::sqrt(discriminant);
+    const float near = (-half_b - sqrtd) / r.a;
+    const float far = (-half_b + sqrtd) / r.a;
+    if (near >= t_min && near <= t_max)
+        return near;
+    if (far >= t_min && far <= t_max)
+        return far;
+    return std::numeric_limits<float>::quiet_NaN();
+}
+
+template <Hittable Other>
+bool sphere_store::hit(const sphere_ray& r, std::size_t first, std::size_t count, float t_min,
+                       float& t_max, hit_record& rec) const
+{
+    const std::size_t end = first + count;
+    std::size_t best = end;
+    float closest = t_max;
+    // Whole groups of lanes, then the rest one by one. Nothing past the leaf is loaded, a lazy
+    // BVH may be filling in the slots of the next one.
+    std::size_t base = first;
+    for (; base + lanes <= end; base += lanes)
+    {
+        float t[lanes];
+        test(r, base, t_min, closest, t);
+        for (std::size_t l = 0; l < lanes; ++l)
+        {
+            if (t[l] <= closest)
+            {
+                closest = t[l];
+                best = base + l;
+            }
+        }
+    }
+    for (; base < end; ++base)
+    {
+        float t = test(r, base, t_min, closest);
+        if (t <= closest)
+        {
+            closest = t;
+            best = base;
+        }
+    }
+
+    bool found = best != end;
+    if (!others.empty())
+    {
+        for (std::size_t i = first; i < end; ++i)
+        {
+            hit_record temp;
+            const auto* other = static_cast<const Other*>(others[i]);
+            if (other && other->hit(r.r, t_min, closest, temp))
+            {
+                rec = temp;
+                closest = temp.t;
+                best = end;
+                found = true;
+            }
+        }
+    }
+
+    if (best != end)
+    {
+        rec.t = closest;
+        rec.p = r.r.at(closest);
+
+        glm::vec3 outward_normal = (rec.p - glm::vec3(x[best], y[best], z[best])) / radius[best];
+
+        rec.normal = glm::faceforward(outward_normal, outward_normal, r.r.direction);
+        rec.front_face = rec.normal == outward_normal;
+        rec.mat_id = mat_id[best];
+    }
+    if (found)
+        t_max = closest;
+    return found;
+}
+
+template bool sphere_store::hit<triangle>(const sphere_ray&, std::size_t, std::size_t, float,
+                                          float&, hit_record&) const;
+template bool sphere_store::hit<hittable>(const sphere_ray&, std::size_t, std::size_t, float,
+                                          float&, hit_record&) const;
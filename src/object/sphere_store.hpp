@@ -0,0 +1,75 @@
+// Ray tracing with a cone tree
+// Copyright © 2022 otreblan
+//
+// cone-tree is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// cone-tree is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with cone-tree.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+#ifdef __SSE2__
+#include <immintrin.h>
+#endif
+
+#include "hittable.hpp"
+
+// Values of a ray shared by every sphere it is tested against
+struct sphere_ray
+{
+    explicit sphere_ray(const ray& r);
+
+    const ray& r;
+    float a; // dot(direction, direction)
+#ifdef __SSE2__
+    __m128 ox, oy, oz, dx, dy, dz, a4;
+#endif
+};
+
+// Copy of the spheres of a tree, packed in the order its leaves reference objects so a leaf is a
+// contiguous run of slots. Centers and radii are stored as separate arrays and tested lanes at a
+// time without virtual calls. Slots holding any other primitive have a NaN radius and are tested
+// through their hittable.
+class sphere_store
+{
+public:
+    static constexpr std::size_t lanes = 4;
+
+    // Slot i holds objects[order[i]]. Stays empty when there isn't a single sphere, the tree keeps
+    // its own loop then.
+    void build(const std::vector<std::unique_ptr<hittable>>& objects, const int* order,
+               std::size_t count);
+    void clear() noexcept;
+    [[nodiscard]] bool empty() const noexcept { return x.empty(); }
+    // Puts object in slot, growing the store if needed, nullptr leaves the slot empty
+    void assign(std::size_t slot, const hittable* object);
+
+    // Closest hit among slots [first, first + count) within [t_min, t_max], shrinks t_max to it.
+    // Slots that aren't spheres are tested as an Other, see primitive_types.
+    template <Hittable Other>
+    bool hit(const sphere_ray& r, std::size_t first, std::size_t count, float t_min, float& t_max,
+             hit_record& rec) const;
+
+private:
+    // Hit time of lanes slots from first, NaN where they miss
+    void test(const sphere_ray& r, std::size_t first, float t_min, float t_max, float* t) const;
+    // The same for slot i alone
+    [[nodiscard]] float test(const sphere_ray& r, std::size_t i, float t_min, float t_max) const;
+
+    std::vector<float> x, y, z, radius;
+    std::vector<material_id> mat_id;
+    std::vector<const hittable*> others; // Only when some slot isn't a sphere
+};
@@ -1,23 +1,68 @@
-
-#pragma once
-
-#include "hittable.hpp"
-#include <glm/glm.hpp>
-
-struct triangle : public hittable
-{
-    glm::vec3 vertex0;
-    glm::vec3 vertex1;
-    glm::vec3 vertex2;
-    std::shared_ptr<material> mat_ptr;
-
-    glm::vec3 m_normal = glm::normalize(glm::cross(vertex2 - vertex0, vertex1 - vertex0));
-    glm::vec3 m_centroid = (vertex0 + vertex1 + vertex2) / 3.0f;
-
-    triangle(const glm::vec3& v0, const glm::vec3& v1, const glm::vec3& v2,
-             std::shared_ptr<material> m);
-
-    [[nodiscard]] auto centroid() const noexcept -> glm::vec3 override;
-    [[nodiscard]] auto bounding_box() const noexcept -> AABB override;
-    bool hit(const ray& ray, float t_min, float t_max, hit_record& hit) const noexcept override;
-};
\ No newline at end of file
+
+#pragma once
+
+#include "hittable.hpp"
+#include <glm/glm.hpp>
+
+// Final, and hit() defined here, so trees that know they hold triangles call it directly
+struct triangle final : public hittable
+{
+    glm::vec3 vertex0;
+    glm::vec3 vertex1;
+    glm::vec3 vertex2;
+    material_id mat_id;
+
+    glm::vec3 m_normal = glm::normalize(glm::cross(vertex2 - vertex0, vertex1 - vertex0));
+    glm::vec3 m_centroid = (vertex0 + vertex1 + vertex2) / 3.0f;
+
+    triangle(const glm::vec3& v0, const glm::vec3& v1, const glm::vec3& v2,
+             material_id m);
+
+    [[nodiscard]] auto centroid() const noexcept -> glm::vec3 override;
+    [[nodiscard]] auto bounding_box() const noexcept -> AABB override;
+    bool hit(const ray& ray, float t_min, float t_max, hit_record& hit) const noexcept override;
+    // The test behind hit(), for triangles that aren't stored as objects
+    static bool intersect(const glm::vec3& vertex0, const glm::vec3& vertex1,
+                          const glm::vec3& vertex2, const glm::vec3& normal, material_id mat_id,
+                          const ray& ray, float t_min, float t_max, hit_record& hit) noexcept;
+};
+
+inline bool triangle::hit(const ray& ray, float t_min, float t_max,
+                          hit_record& hit) const noexcept
+{
+    return intersect(vertex0, vertex1, vertex2, m_normal, mat_id, ray, t_min, t_max, hit);
+}
+
+inline bool triangle::intersect(const glm::vec3& vertex0, const glm::vec3& vertex1,
+                                const glm::vec3& vertex2, const glm::vec3& normal,
+                                material_id mat_id, const ray& ray, float t_min, float t_max,
+                                hit_record& hit) noexcept
+{
+    const auto edge1 = vertex1 - vertex0;
+    const auto edge2 = vertex2 - vertex0;
+    const auto h = cross(ray.direction, edge2);
+    const float a = dot(edge1, h);
+    if (a > -0.0001f && a < 0.0001f)
+        return false; // ray parallel to triangle
+    const float f = 1 / a;
+    const auto s = ray.origin - vertex0;
+    const float u = f * dot(s, h);
+    if (u < 0 || u > 1)
+        return false;
+    const auto q = cross(s, edge1);
+    const float v = f * dot(ray.direction, q);
+    if (v < 0 || u + v > 1)
+        return false;
+    const float t = f * dot(edge2, q);
+    if (t > t_min && t < t_max)
+    {
+        hit.t = t;
+        hit.p = ray.at(t);
+
+        hit.front_face = dot(ray.direction, normal) < 0;
+        hit.normal = normal * (hit.front_face ? 1.0f : -1.0f);
+        hit.mat_id = mat_id;
+        return true;
+    }
+    return false;
+}
@@ -0,0 +1,123 @@
+// Ray tracing with a cone tree
+// Copyright © 2022 otreblan
+//
+// cone-tree is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// cone-tree is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with cone-tree.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "cluster_cache.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+
+cluster_cache::cluster_cache(int fd, const std::vector<cluster_info>& clusters, std::size_t budget)
+    : fd(fd), clusters(clusters), budget(budget), slots(clusters.size())
+{
+}
+
+cluster_cache::~cluster_cache()
+{
+    for (std::size_t c = 0; c < slots.size(); c++)
+    {
+        if (slots[c].data)
+            munmap(slots[c].data, clusters[c].bytes);
+    }
+}
+
+cluster_view cluster_cache::acquire(int cluster)
+{
+    std::lock_guard lock(mutex);
+    slot& s = slots[cluster];
+    if (!s.data)
+    {
+        const std::size_t bytes = clusters[cluster].bytes;
+        evict(bytes);
+
+        // Read the whole cluster now instead of one page fault at a time
+        void* data = mmap(nullptr, bytes, PROT_READ, MAP_SHARED | MAP_POPULATE, fd,
+                          (off_t)clusters[cluster].offset);
+        if (data == MAP_FAILED)
+        {
+            throw std::runtime_error(std::string("Failed to map a cluster: ") +
+                                     std::strerror(errno));
+        }
+        s.data = data;
+        lru.push_front(cluster);
+        s.used = lru.begin();
+        mapped += bytes;
+        counters.loads++;
+        counters.peak_bytes = std::max(counters.peak_bytes, mapped);
+    }
+    else
+    {
+        lru.splice(lru.begin(), lru, s.used);
+    }
+    s.pins++;
+    return cluster_view(s.data);
+}
+
+std::optional<cluster_view> cluster_cache::try_acquire(int cluster)
+{
+    std::lock_guard lock(mutex);
+    slot& s = slots[cluster];
+    if (!s.data)
+        return std::nullopt;
+    lru.splice(lru.begin(), lru, s.used);
+    s.pins++;
+    return cluster_view(s.data);
+}
+
+void cluster_cache::release(int cluster)
+{
+    std::lock_guard lock(mutex);
+    slots[cluster].pins--;
+}
+
+void cluster_cache::prefetch(int cluster) const
+{
+    posix_fadvise(fd, (off_t)clusters[cluster].offset, (off_t)clusters[cluster].bytes,
+                  POSIX_FADV_WILLNEED);
+}
+
+cache_stats cluster_cache::stats() const
+{
+    std::lock_guard lock(mutex);
+    cache_stats stats = counters;
+    stats.clusters = clusters.size();
+    for (const cluster_info& cluster : clusters)
+        stats.file_bytes += cluster.bytes;
+    return stats;
+}
+
+void cluster_cache::evict(std::size_t incoming)
+{
+    for (auto it = lru.end(); it != lru.begin() && mapped + incoming > budget;)
+    {
+        --it;
+        slot& s = slots[*it];
+        if (s.pins > 0)
+            continue;
+
+        munmap(s.data, clusters[*it].bytes);
+        mapped -= clusters[*it].bytes;
+        s.data = nullptr;
+        it = lru.erase(it);
+        counters.evictions++;
+    }
+}
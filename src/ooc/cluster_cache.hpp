@@ -0,0 +1,78 @@
+// Ray tracing with a cone tree
+// Copyright © 2022 otreblan
+//
+// cone-tree is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// cone-tree is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with cone-tree.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+#include "cluster_file.hpp"
+
+struct cache_stats
+{
+    std::size_t clusters = 0;
+    std::uint64_t file_bytes = 0;
+    std::uint64_t loads = 0;     // Clusters mapped
+    std::uint64_t evictions = 0; // Clusters unmapped to stay within the budget
+    std::size_t peak_bytes = 0;  // Most bytes mapped at once
+};
+
+// Clusters mapped on demand, keeping at most budget bytes mapped by unmapping the least recently
+// used ones. A cluster in use is pinned between acquire() and release() and never unmapped, so
+// the budget is only exceeded when every mapped cluster is pinned.
+class cluster_cache
+{
+public:
+    cluster_cache(int fd, const std::vector<cluster_info>& clusters, std::size_t budget);
+    cluster_cache(const cluster_cache&) = delete;
+    cluster_cache& operator=(const cluster_cache&) = delete;
+    ~cluster_cache();
+
+    // Maps the cluster if it isn't, waiting for it to be read
+    cluster_view acquire(int cluster);
+    // Only pins clusters that are already mapped
+    std::optional<cluster_view> try_acquire(int cluster);
+    void release(int cluster);
+    // Starts reading a cluster in the background without mapping it
+    void prefetch(int cluster) const;
+
+    [[nodiscard]] cache_stats stats() const;
+
+private:
+    struct slot
+    {
+        void* data = nullptr;
+        int pins = 0;
+        std::list<int>::iterator used; // In lru while mapped
+    };
+
+    void evict(std::size_t incoming);
+
+    int fd;
+    const std::vector<cluster_info>& clusters;
+    std::size_t budget;
+
+    mutable std::mutex mutex;
+    std::vector<slot> slots;
+    std::list<int> lru; // Mapped clusters, most recently acquired first
+    std::size_t mapped = 0;
+    cache_stats counters;
+};
@@ -0,0 +1,433 @@
+// Ray tracing with a cone tree
+// Copyright © 2022 otreblan
+//
+// cone-tree is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// cone-tree is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with cone-tree.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "cluster_file.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <numeric>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "../object/sphere.hpp"
+#include "../object/triangle.hpp"
+#include "../rtx/ray_sort.hpp"
+
+// Nodes start one cache line into a cluster, after its header
+struct cluster_header
+{
+    std::uint32_t nodes;
+    std::uint32_t primitives;
+};
+constexpr std::size_t cluster_header_bytes = 64;
+
+// Morton bits per axis of the buckets of the counting sort, 2^18 counters
+constexpr int bucket_bits = 6;
+
+packed_primitive packed_primitive::pack(const hittable& object)
+{
+    if (const auto* s = dynamic_cast<const sphere*>(&object))
+    {
+        return {s->center, glm::vec3(s->radius, 0.f, 0.f), glm::vec3(0.f), glm::vec3(0.f),
+                s->mat_id, primitive_kind::sphere};
+    }
+    if (const auto* t = dynamic_cast<const triangle*>(&object))
+    {
+        return {t->vertex0, t->vertex1, t->vertex2, t->m_normal, t->mat_id,
+                primitive_kind::triangle};
+    }
+    throw std::runtime_error("The ooc scene can only store spheres and triangles");
+}
+
+std::unique_ptr<hittable> packed_primitive::unpack() const
+{
+    if (kind == primitive_kind::sphere)
+        return std::make_unique<sphere>(v0, v1.x, mat_id);
+    return std::make_unique<triangle>(v0, v1, v2, mat_id);
+}
+
+glm::vec3 packed_primitive::centroid() const noexcept
+{
+    if (kind == primitive_kind::sphere)
+        return v0;
+    return (v0 + v1 + v2) / 3.0f;
+}
+
+AABB packed_primitive::bounding_box() const noexcept
+{
+    if (kind == primitive_kind::sphere)
+        return AABB{v0 - glm::vec3(v1.x), v0 + glm::vec3(v1.x)};
+    return {glm::min(glm::min(v0, v1), v2), glm::max(glm::max(v0, v1), v2)};
+}
+
+bool packed_primitive::hit(const ray& r, float t_min, float t_max, hit_record& rec) const noexcept
+{
+    if (kind == primitive_kind::sphere)
+        return sphere::intersect(v0, v1.x, mat_id, r, t_min, t_max, rec);
+    return triangle::intersect(v0, v1, v2, normal, mat_id, r, t_min, t_max, rec);
+}
+
+cluster_view::cluster_view(const void* data)
+{
+    const auto* bytes = static_cast<const std::byte*>(data);
+    const auto* header = reinterpret_cast<const cluster_header*>(bytes);
+    nodes = reinterpret_cast<const BVHNode*>(bytes + cluster_header_bytes);
+    primitives = reinterpret_cast<const packed_primitive*>(nodes + header->nodes);
+}
+
+// Same traversal as BVH::hit()
+bool cluster_view::hit(const ray& r, float t_min, float& t_max, hit_record& rec) const
+{
+    const BVHNode *node = nodes, *stack[256];
+    int stackPtr = 0;
+    bool hitSomething = false;
+
+    TRAVERSAL_STATS(stats);
+
+    while (true)
+    {
+        STATS_ADD(stats, nodes, 1);
+        if (node->isLeaf())
+        {
+            STATS_ADD(stats, leaves, 1);
+            STATS_ADD(stats, primitives, node->triCount);
+            for (int i = 0; i < node->triCount; i++)
+            {
+                hit_record temp;
+                if (primitives[node->leftFirst + i].hit(r, t_min, t_max, temp))
+                {
+                    rec = temp;
+                    hitSomething = true;
+                    t_max = temp.t;
+                }
+            }
+            if (stackPtr == 0)
+                break;
+            node = stack[--stackPtr];
+            continue;
+        }
+        const BVHNode* child1 = &nodes[node->leftFirst];
+        const BVHNode* child2 = &nodes[node->leftFirst + 1];
+        float dist1 = child1->aabb.intersection_time(r, t_min, t_max).first;
+        float dist2 = child2->aabb.intersection_time(r, t_min, t_max).first;
+        if (dist1 > dist2)
+        {
+            std::swap(dist1, dist2);
+            std::swap(child1, child2);
+        }
+        if (dist1 == 1e30f)
+        {
+            if (stackPtr == 0)
+                break;
+            node = stack[--stackPtr];
+        }
+        else
+        {
+            node = child1;
+            if (dist2 != 1e30f)
+                stack[stackPtr++] = child2;
+        }
+    }
+    return hitSomething;
+}
+
+static std::runtime_error system_error(const std::string& what)
+{
+    return std::runtime_error(what + ": " + std::strerror(errno));
+}
+
+// Unlinked right away, the kernel frees it once it's closed
+static int scratch_file(const std::string& dir)
+{
+    std::string path =
+        (dir.empty() ? std::filesystem::temp_directory_path().string() : dir) + "/cone-tree-XXXXXX";
+    int fd = mkstemp(path.data());
+    if (fd < 0)
+        throw system_error("Failed to create " + path);
+    unlink(path.c_str());
+    return fd;
+}
+
+static void write_at(int fd, const void* data, std::size_t bytes, std::uint64_t offset)
+{
+    const auto* next = static_cast<const char*>(data);
+    while (bytes > 0)
+    {
+        ssize_t written = pwrite(fd, next, bytes, (off_t)offset);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            throw system_error("Failed to write the clusters");
+        }
+        next += written;
+        bytes -= written;
+        offset += written;
+    }
+}
+
+static void* map_file(int fd, std::size_t bytes, int protection)
+{
+    void* data = mmap(nullptr, bytes, protection, MAP_SHARED, fd, 0);
+    if (data == MAP_FAILED)
+        throw system_error("Failed to map the clusters");
+    return data;
+}
+
+static std::uint32_t bucket_of(const packed_primitive& primitive, const AABB& bounds, int bits)
+{
+    glm::vec3 extent = glm::max(bounds.max - bounds.min, glm::vec3(1e-6f));
+    return morton((primitive.centroid() - bounds.min) / extent, bits);
+}
+
+cluster_file::cluster_file(std::string dir) : dir(std::move(dir)) {}
+
+cluster_file::~cluster_file() { clear(); }
+
+void cluster_file::add(const packed_primitive& primitive)
+{
+    if (spill < 0)
+        spill = scratch_file(dir);
+
+    glm::vec3 c = primitive.centroid();
+    centroid_bounds.min = glm::min(centroid_bounds.min, c);
+    centroid_bounds.max = glm::max(centroid_bounds.max, c);
+
+    buffer.push_back(primitive);
+    if (buffer.size() == 4096)
+        flush();
+}
+
+void cluster_file::flush()
+{
+    write_at(spill, buffer.data(), buffer.size() * sizeof(packed_primitive),
+             count * sizeof(packed_primitive));
+    count += buffer.size();
+    buffer.clear();
+}
+
+void cluster_file::clear()
+{
+    if (spill >= 0)
+        close(spill);
+    if (file >= 0)
+        close(file);
+    spill = file = -1;
+    buffer.clear();
+    count = 0;
+    centroid_bounds = {};
+    info.clear();
+    top_nodes.clear();
+    cluster_depth.clear();
+    shape = {};
+}
+
+void cluster_file::build(std::size_t cluster_size, const sah_params& sah, int treelet_rounds,
+                         node_layout layout)
+{
+    if (spill >= 0)
+        flush();
+    if (file >= 0)
+        close(file);
+    file = -1;
+    info.clear();
+    top_nodes.clear();
+    cluster_depth.clear();
+    shape = {};
+    shape.primitives = count;
+    if (count == 0)
+        return;
+
+    // Counting sort of the spilled primitives into a second file
+    const std::size_t bytes = count * sizeof(packed_primitive);
+    int sortedFile = scratch_file(dir);
+    if (ftruncate(sortedFile, (off_t)bytes) != 0)
+        throw system_error("Failed to size the clusters");
+    auto* spilled = static_cast<packed_primitive*>(map_file(spill, bytes, PROT_READ));
+    auto* sorted =
+        static_cast<packed_primitive*>(map_file(sortedFile, bytes, PROT_READ | PROT_WRITE));
+    close(sortedFile);
+
+    std::vector<std::size_t> offset((std::size_t(1) << (3 * bucket_bits)) + 1);
+    for (std::size_t i = 0; i < count; i++)
+        offset[bucket_of(spilled[i], centroid_bounds, bucket_bits) + 1]++;
+    std::partial_sum(offset.begin(), offset.end(), offset.begin());
+    {
+        std::vector<std::size_t> next(offset.begin(), offset.end() - 1);
+        for (std::size_t i = 0; i < count; i++)
+            sorted[next[bucket_of(spilled[i], centroid_bounds, bucket_bits)]++] = spilled[i];
+    }
+    munmap(spilled, bytes);
+
+    // Runs of whole buckets up to cluster_size, a bucket bigger than that is sorted by a finer
+    // code and cut in even parts
+    cluster_size = std::max<std::size_t>(cluster_size, 1);
+    std::vector<std::pair<std::size_t, std::size_t>> ranges;
+    std::size_t first = 0;
+    for (std::size_t b = 0; b + 1 < offset.size(); b++)
+    {
+        std::size_t begin = offset[b], end = offset[b + 1];
+        if (end - begin <= cluster_size)
+        {
+            if (end - first > cluster_size)
+            {
+                ranges.emplace_back(first, begin);
+                first = begin;
+            }
+            continue;
+        }
+
+        if (begin > first)
+            ranges.emplace_back(first, begin);
+        std::sort(sorted + begin, sorted + end,
+                  [&](const packed_primitive& a, const packed_primitive& b)
+                  {
+                      return bucket_of(a, centroid_bounds, 10) < bucket_of(b, centroid_bounds, 10);
+                  });
+        std::size_t parts = (end - begin + cluster_size - 1) / cluster_size;
+        for (std::size_t part = 0; part < parts; part++)
+        {
+            ranges.emplace_back(begin + (end - begin) * part / parts,
+                                begin + (end - begin) * (part + 1) / parts);
+        }
+        first = end;
+    }
+    if (first < count)
+        ranges.emplace_back(first, count);
+
+    info.resize(ranges.size());
+    for (std::size_t c = 0; c < ranges.size(); c++)
+    {
+        info[c].primitives = ranges[c].second - ranges[c].first;
+        for (std::size_t i = ranges[c].first; i < ranges[c].second; i++)
+        {
+            AABB box = sorted[i].bounding_box();
+            info[c].bounds.min = glm::min(info[c].bounds.min, box.min);
+            info[c].bounds.max = glm::max(info[c].bounds.max, box.max);
+        }
+    }
+
+    top_nodes.assign(std::max<std::size_t>(2 * info.size(), 2), {});
+    cluster_depth.assign(info.size(), 0);
+    top_used = 1;
+    build_top(0, 0, (int)info.size(), 0);
+    top_nodes.resize(top_used);
+
+    // The leaves of the top tree are the roots of the clusters, those count as cluster nodes
+    root_area = top_nodes[0].aabb.area();
+    for (const BVHNode& node : top_nodes)
+    {
+        if (!node.isLeaf())
+            shape.add_inner(0, relative_area(node.aabb), sah.traverse);
+    }
+
+    // Clusters one at a time, the sorted pages behind them are dropped as they are done
+    file = scratch_file(dir);
+    const std::uint64_t page = sysconf(_SC_PAGESIZE);
+    std::uint64_t end = 0;
+    for (std::size_t c = 0; c < ranges.size(); c++)
+    {
+        info[c].offset = (end + page - 1) / page * page;
+        write_cluster(sorted + ranges[c].first, info[c].primitives, sah, treelet_rounds, layout,
+                      cluster_depth[c], info[c]);
+        end = info[c].offset + info[c].bytes;
+
+        auto done = reinterpret_cast<std::uintptr_t>(sorted + ranges[c].second) / page * page;
+        auto start = reinterpret_cast<std::uintptr_t>(sorted);
+        if (done > start)
+            madvise(sorted, done - start, MADV_DONTNEED);
+    }
+    munmap(sorted, bytes);
+}
+
+void cluster_file::build_top(int node, int first, int count, int depth)
+{
+    BVHNode& top = top_nodes[node];
+    if (count == 1)
+    {
+        top.aabb = info[first].bounds;
+        top.leftFirst = first;
+        top.triCount = 1;
+        cluster_depth[first] = depth;
+        return;
+    }
+
+    int left = top_used;
+    top_used += 2;
+    build_top(left, first, count / 2, depth + 1);
+    build_top(left + 1, first + count / 2, count - count / 2, depth + 1);
+
+    top.leftFirst = left;
+    top.triCount = 0;
+    top.aabb.min = glm::min(top_nodes[left].aabb.min, top_nodes[left + 1].aabb.min);
+    top.aabb.max = glm::max(top_nodes[left].aabb.max, top_nodes[left + 1].aabb.max);
+}
+
+void cluster_file::write_cluster(const packed_primitive* primitives, std::size_t count,
+                                 const sah_params& sah, int treelet_rounds, node_layout layout,
+                                 int depth, cluster_info& cluster)
+{
+    BVH bvh;
+    for (std::size_t i = 0; i < count; i++)
+        bvh.add(primitives[i].unpack());
+    bvh.build(sah);
+    bvh.optimizeTreelets(treelet_rounds);
+    bvh.reorder(layout);
+
+    cluster_header header = {(std::uint32_t)bvh.nodesUsed, (std::uint32_t)count};
+    cluster.bytes = cluster_header_bytes + header.nodes * sizeof(BVHNode) +
+                    count * sizeof(packed_primitive);
+
+    std::vector<std::byte> data(cluster.bytes);
+    std::memcpy(data.data(), &header, sizeof(header));
+    std::memcpy(data.data() + cluster_header_bytes, bvh.bvhNode.data(),
+                header.nodes * sizeof(BVHNode));
+    auto* leafOrder = reinterpret_cast<packed_primitive*>(data.data() + cluster_header_bytes +
+                                                          header.nodes * sizeof(BVHNode));
+    for (std::size_t i = 0; i < count; i++)
+        leafOrder[i] = primitives[bvh.triIdx[i]];
+    write_at(file, data.data(), data.size(), cluster.offset);
+
+    std::vector<std::pair<int, int>> stack = {{0, depth}};
+    while (!stack.empty())
+    {
+        auto [nodeIdx, nodeDepth] = stack.back();
+        stack.pop_back();
+
+        const BVHNode& node = bvh.bvhNode[nodeIdx];
+        if (node.isLeaf())
+        {
+            shape.add_leaf(nodeDepth, relative_area(node.aabb), node.triCount, sah.intersect);
+        }
+        else
+        {
+            shape.add_inner(nodeDepth, relative_area(node.aabb), sah.traverse);
+            stack.emplace_back(node.leftFirst, nodeDepth + 1);
+            stack.emplace_back(node.leftFirst + 1, nodeDepth + 1);
+        }
+    }
+}
+
+float cluster_file::relative_area(const AABB& box) const noexcept
+{
+    return root_area > 0 ? box.area() / root_area : 1.f;
+}
@@ -0,0 +1,123 @@
+// Ray tracing with a cone tree
+// Copyright © 2022 otreblan
+//
+// cone-tree is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// cone-tree is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with cone-tree.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "../bvh/bvh.hpp"
+#include "../layout.hpp"
+#include "../math/aabb.hpp"
+#include "../object/hittable.hpp"
+#include "../sah.hpp"
+#include "../stats.hpp"
+
+enum class primitive_kind : std::uint32_t
+{
+    sphere,
+    triangle,
+};
+
+// A primitive as it is stored on disk, plain data that can be read straight from a mapping
+struct packed_primitive
+{
+    glm::vec3 v0;     // Sphere center
+    glm::vec3 v1;     // Sphere radius in x
+    glm::vec3 v2;
+    glm::vec3 normal; // Triangles only
+    material_id mat_id;
+    primitive_kind kind;
+
+    // Throws for primitives that have no packed form
+    static packed_primitive pack(const hittable& object);
+    [[nodiscard]] std::unique_ptr<hittable> unpack() const;
+    [[nodiscard]] glm::vec3 centroid() const noexcept;
+    [[nodiscard]] AABB bounding_box() const noexcept;
+    bool hit(const ray& r, float t_min, float t_max, hit_record& rec) const noexcept;
+};
+
+// Where a cluster is in the file. A cluster is a BVH over some nearby primitives, written as its
+// node count, its nodes and then its primitives in the order its leaves reference them.
+struct cluster_info
+{
+    AABB bounds;
+    std::uint64_t offset = 0; // Page aligned, so it can be mapped on its own
+    std::uint64_t bytes = 0;
+    std::uint32_t primitives = 0;
+};
+
+// The parts of a mapped cluster
+struct cluster_view
+{
+    const BVHNode* nodes;
+    const packed_primitive* primitives;
+
+    explicit cluster_view(const void* data);
+    // Closest hit within [t_min, t_max], shrinks t_max to it
+    bool hit(const ray& r, float t_min, float& t_max, hit_record& rec) const;
+};
+
+// Builds the file of clusters without ever holding the whole scene in memory. Primitives are
+// streamed to a scratch file as they are added, freeze() counting sorts them by the Morton code of
+// their centroids (a second scratch file, both are mapped) and cuts that order into clusters of
+// up to cluster_size primitives, which are built and written one at a time. Every file is
+// unlinked as soon as it is created.
+class cluster_file
+{
+public:
+    explicit cluster_file(std::string dir = {});
+    cluster_file(const cluster_file&) = delete;
+    cluster_file& operator=(const cluster_file&) = delete;
+    ~cluster_file();
+
+    void add(const packed_primitive& primitive);
+    void build(std::size_t cluster_size, const sah_params& sah, int treelet_rounds,
+               node_layout layout);
+    void clear();
+
+    [[nodiscard]] int fd() const noexcept { return file; }
+    [[nodiscard]] const std::vector<cluster_info>& clusters() const noexcept { return info; }
+    // Clusters are leaves of this tree, leftFirst is their index
+    [[nodiscard]] const std::vector<BVHNode>& top() const noexcept { return top_nodes; }
+    [[nodiscard]] const build_stats& stats() const noexcept { return shape; }
+
+private:
+    void flush();
+    void build_top(int node, int first, int count, int depth);
+    int top_used = 1;
+    void write_cluster(const packed_primitive* primitives, std::size_t count,
+                       const sah_params& sah, int treelet_rounds, node_layout layout, int depth,
+                       cluster_info& cluster);
+    [[nodiscard]] float relative_area(const AABB& box) const noexcept;
+
+    std::string dir;
+    int spill = -1; // Primitives in the order they were added
+    int file = -1;  // The clusters
+    std::vector<packed_primitive> buffer;
+    std::size_t count = 0;
+    AABB centroid_bounds;
+
+    std::vector<cluster_info> info;
+    std::vector<BVHNode> top_nodes;
+    std::vector<int> cluster_depth;
+    build_stats shape;
+    float root_area = 0;
+};
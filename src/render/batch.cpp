@@ -0,0 +1,119 @@
+// Ray tracing with a cone tree
+// Copyright © 2022 otreblan
+//
+// cone-tree is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// cone-tree is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with cone-tree.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "batch.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+#include "../rtx/rtweekend.hpp"
+
+// Rows handed out at a time
+constexpr int band_rows = 8;
+
+std::vector<batch_view> read_views(const std::string& path, const render_job& defaults)
+{
+    std::ifstream file(path);
+    if (!file.is_open())
+        throw std::runtime_error("Failed to open " + path);
+
+    std::vector<batch_view> views;
+    std::string line;
+    for (int number = 1; std::getline(file, line); number++)
+    {
+        auto start = line.find_first_not_of(" \t");
+        if (start == std::string::npos || line[start] == '#')
+            continue;
+        auto end = line.find_first_of(" \t", start);
+
+        batch_view view = {line.substr(start, end - start), defaults};
+        try
+        {
+            if (end != std::string::npos)
+                parse_job(std::string_view(line).substr(end), view.job);
+        }
+        catch (const std::runtime_error& e)
+        {
+            throw std::runtime_error(path + ":" + std::to_string(number) + ": " + e.what());
+        }
+        views.push_back(std::move(view));
+    }
+    return views;
+}
+
+batch_stats render_batch(const scene& world, const std::vector<batch_view>& views, int threads,
+                         std::vector<std::vector<glm::vec3>>& images)
+{
+    struct band
+    {
+        int view;
+        int first_row;
+        int rows;
+    };
+    std::vector<band> bands;
+    std::vector<camera> cameras;
+    images.resize(views.size());
+    for (int v = 0; v < (int)views.size(); v++)
+    {
+        const render_settings& settings = views[v].job.settings;
+        images[v].assign((std::size_t)settings.width * settings.height, glm::vec3(0.f));
+        cameras.push_back(views[v].job.make_camera());
+        for (int first_row = 0; first_row < settings.height; first_row += band_rows)
+            bands.push_back({v, first_row, std::min(band_rows, settings.height - first_row)});
+    }
+
+    batch_stats stats;
+    stats.bands = (int)bands.size();
+    stats.threads = std::clamp<int>(threads, 1, std::max<int>(stats.bands, 1));
+
+    std::atomic<std::size_t> next = 0;
+    std::mutex merge;
+    auto work = [&]
+    {
+        path_stats paths;
+        std::vector<glm::vec3> block;
+        for (std::size_t i = next++; i < bands.size(); i = next++)
+        {
+            const band& b = bands[i];
+            const render_job& job = views[b.view].job;
+            const int width = job.settings.width;
+
+            block.assign((std::size_t)b.rows * width, glm::vec3(0.f));
+            seed_random(job.seed + 0x9e3779b9u * (unsigned)(b.first_row + 1));
+            paths += render_rows(world, cameras[b.view], job.settings, b.first_row, b.rows, block);
+
+            // Bands never overlap, every thread writes its own rows
+            std::copy(block.begin(), block.end(),
+                      images[b.view].begin() + (std::ptrdiff_t)b.first_row * width);
+        }
+
+        std::lock_guard lock(merge);
+        stats.paths += paths;
+    };
+
+    std::vector<std::thread> pool;
+    for (int t = 1; t < stats.threads; t++)
+        pool.emplace_back(work);
+    work();
+    for (auto& thread : pool)
+        thread.join();
+    return stats;
+}
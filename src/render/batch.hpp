@@ -0,0 +1,51 @@
+// Ray tracing with a cone tree
+// Copyright © 2022 otreblan
+//
+// cone-tree is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// cone-tree is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with cone-tree.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <glm/vec3.hpp>
+
+#include "../scene/scene.hpp"
+#include "job.hpp"
+#include "render.hpp"
+
+struct batch_view
+{
+    std::string output;
+    render_job job;
+};
+
+struct batch_stats
+{
+    int threads = 0;
+    int bands = 0;
+    path_stats paths;
+};
+
+// One view per line, "OUTPUT [key=value]..." with the keys of parse_job() on top of defaults.
+// Blank lines and lines starting with # are skipped. Throws std::runtime_error.
+std::vector<batch_view> read_views(const std::string& path, const render_job& defaults);
+
+// Every view over the same frozen scene with one pool of threads. The bands of rows of all the
+// views go in a single queue, so threads go on with the next view as soon as one runs out of
+// work instead of waiting for its slowest band. Bands reseed the random numbers from the view
+// seed and their first row, so the images don't depend on the number of threads.
+batch_stats render_batch(const scene& world, const std::vector<batch_view>& views, int threads,
+                         std::vector<std::vector<glm::vec3>>& images);
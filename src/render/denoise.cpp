@@ -0,0 +1,292 @@
+// Ray tracing with a cone tree
+// Copyright © 2022 otreblan
+//
+// cone-tree is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// cone-tree is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with cone-tree.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "denoise.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+
+// B3 spline
+constexpr float kernel[5] = {1.f / 16.f, 1.f / 4.f, 3.f / 8.f, 1.f / 4.f, 1.f / 16.f};
+
+constexpr float albedo_floor = 1e-3f;
+constexpr float depth_floor = 1e-6f;
+
+// One array per channel, so four neighbouring pixels load at once
+struct channels
+{
+    std::vector<float> c[3];
+
+    explicit channels(std::size_t pixels)
+    {
+        for (auto& channel : c)
+            channel.resize(pixels);
+    }
+};
+
+// Everything a pass reads and writes, and what it multiplies the squared differences by
+struct pass
+{
+    int width;
+    int height;
+    int step;
+    float color;
+    float albedo;
+    float normal;
+    float depth; // Before dividing by the depth of the filtered pixel
+
+    const float* in[3];
+    float* out[3];
+    const float* albedos[3];
+    const float* normals[3];
+    const float* depths;
+};
+
+// e^x for x <= 0 within about 2e-4: 2^t is split into 2^floor(t), added to the exponent bits,
+// times a polynomial for the rest. The SSE version takes exactly the same steps, so a pixel gets
+// the same weights whichever of the two filters it.
+float fast_exp(float x)
+{
+    float t = std::max(x, -80.f) * 1.44269504f;
+    float i = std::floor(t);
+    float f = t - i;
+    float p = 1.f + f * (0.693147f + f * (0.240227f + f * (0.0555041f +
+                                                           f * (0.00961813f + f * 0.00133336f))));
+    std::int32_t bits;
+    std::memcpy(&bits, &p, sizeof(bits));
+    bits += (std::int32_t)i * (1 << 23);
+    std::memcpy(&p, &bits, sizeof(p));
+    return p;
+}
+
+float squared_distance(const float* const planes[3], std::size_t a, std::size_t b)
+{
+    float d0 = planes[0][a] - planes[0][b];
+    float d1 = planes[1][a] - planes[1][b];
+    float d2 = planes[2][a] - planes[2][b];
+    return d0 * d0 + d1 * d1 + d2 * d2;
+}
+
+// Taps outside the image are left out
+void filter_pixel(const pass& p, int x, int y)
+{
+    const std::size_t c = (std::size_t)y * p.width + x;
+    const float zscale = 1.f / (p.depth * std::max(p.depths[c], depth_floor));
+
+    float sum[3] = {0.f, 0.f, 0.f};
+    float weights = 0.f;
+    for (int dy = -2; dy <= 2; ++dy)
+    {
+        const int qy = y + dy * p.step;
+        if (qy < 0 || qy >= p.height)
+            continue;
+        for (int dx = -2; dx <= 2; ++dx)
+        {
+            const int qx = x + dx * p.step;
+            if (qx < 0 || qx >= p.width)
+                continue;
+            const std::size_t q = (std::size_t)qy * p.width + qx;
+
+            float dz = (p.depths[q] - p.depths[c]) * zscale;
+            float e = squared_distance(p.in, q, c) * p.color +
+                      squared_distance(p.albedos, q, c) * p.albedo +
+                      squared_distance(p.normals, q, c) * p.normal + dz * dz;
+            float w = kernel[dx + 2] * kernel[dy + 2] * fast_exp(-e);
+
+            for (int ch = 0; ch < 3; ++ch)
+                sum[ch] += w * p.in[ch][q];
+            weights += w;
+        }
+    }
+
+    // The center always counts, so weights is never 0
+    for (int ch = 0; ch < 3; ++ch)
+        p.out[ch][c] = sum[ch] / weights;
+}
+
+#ifdef __SSE2__
+__m128 fast_exp4(__m128 x)
+{
+    __m128 t = _mm_mul_ps(_mm_max_ps(x, _mm_set1_ps(-80.f)), _mm_set1_ps(1.44269504f));
+
+    // Truncation rounds negative numbers up, where the comparison gives -1 to take back
+    __m128i ti = _mm_cvttps_epi32(t);
+    __m128 i = _mm_cvtepi32_ps(ti);
+    __m128 above = _mm_cmpgt_ps(i, t);
+    i = _mm_sub_ps(i, _mm_and_ps(above, _mm_set1_ps(1.f)));
+    ti = _mm_add_epi32(ti, _mm_castps_si128(above));
+
+    __m128 f = _mm_sub_ps(t, i);
+    __m128 p = _mm_add_ps(_mm_set1_ps(0.00961813f), _mm_mul_ps(f, _mm_set1_ps(0.00133336f)));
+    p = _mm_add_ps(_mm_set1_ps(0.0555041f), _mm_mul_ps(f, p));
+    p = _mm_add_ps(_mm_set1_ps(0.240227f), _mm_mul_ps(f, p));
+    p = _mm_add_ps(_mm_set1_ps(0.693147f), _mm_mul_ps(f, p));
+    p = _mm_add_ps(_mm_set1_ps(1.f), _mm_mul_ps(f, p));
+    return _mm_castsi128_ps(_mm_add_epi32(_mm_castps_si128(p), _mm_slli_epi32(ti, 23)));
+}
+
+__m128 squared_distance4(const float* const planes[3], std::size_t a, std::size_t b)
+{
+    __m128 d0 = _mm_sub_ps(_mm_loadu_ps(planes[0] + a), _mm_loadu_ps(planes[0] + b));
+    __m128 d1 = _mm_sub_ps(_mm_loadu_ps(planes[1] + a), _mm_loadu_ps(planes[1] + b));
+    __m128 d2 = _mm_sub_ps(_mm_loadu_ps(planes[2] + a), _mm_loadu_ps(planes[2] + b));
+    return _mm_add_ps(_mm_add_ps(_mm_mul_ps(d0, d0), _mm_mul_ps(d1, d1)), _mm_mul_ps(d2, d2));
+}
+
+// Pixels x to x + 3, whose taps are all inside the row
+void filter_pixels(const pass& p, int x, int y)
+{
+    const std::size_t c = (std::size_t)y * p.width + x;
+    const __m128 zscale = _mm_div_ps(
+        _mm_set1_ps(1.f),
+        _mm_mul_ps(_mm_set1_ps(p.depth),
+                   _mm_max_ps(_mm_loadu_ps(p.depths + c), _mm_set1_ps(depth_floor))));
+    const __m128 color = _mm_set1_ps(p.color);
+    const __m128 albedo = _mm_set1_ps(p.albedo);
+    const __m128 normal = _mm_set1_ps(p.normal);
+    const __m128 sign = _mm_set1_ps(-0.f);
+
+    __m128 sum[3] = {_mm_setzero_ps(), _mm_setzero_ps(), _mm_setzero_ps()};
+    __m128 weights = _mm_setzero_ps();
+    for (int dy = -2; dy <= 2; ++dy)
+    {
+        const int qy = y + dy * p.step;
+        if (qy < 0 || qy >= p.height)
+            continue;
+        for (int dx = -2; dx <= 2; ++dx)
+        {
+            const std::size_t q = (std::size_t)qy * p.width + x + dx * p.step;
+
+            __m128 dz = _mm_mul_ps(
+                _mm_sub_ps(_mm_loadu_ps(p.depths + q), _mm_loadu_ps(p.depths + c)), zscale);
+            __m128 e = _mm_add_ps(
+                _mm_add_ps(_mm_add_ps(_mm_mul_ps(squared_distance4(p.in, q, c), color),
+                                      _mm_mul_ps(squared_distance4(p.albedos, q, c), albedo)),
+                           _mm_mul_ps(squared_distance4(p.normals, q, c), normal)),
+                _mm_mul_ps(dz, dz));
+            __m128 w = _mm_mul_ps(_mm_set1_ps(kernel[dx + 2] * kernel[dy + 2]),
+                                  fast_exp4(_mm_xor_ps(e, sign)));
+
+            for (int ch = 0; ch < 3; ++ch)
+                sum[ch] = _mm_add_ps(sum[ch], _mm_mul_ps(w, _mm_loadu_ps(p.in[ch] + q)));
+            weights = _mm_add_ps(weights, w);
+        }
+    }
+
+    for (int ch = 0; ch < 3; ++ch)
+        _mm_storeu_ps(p.out[ch] + c, _mm_div_ps(sum[ch], weights));
+}
+#endif
+
+void filter_row(const pass& p, int y)
+{
+    int x = 0;
+#ifdef __SSE2__
+    const int reach = 2 * p.step;
+    for (; x < std::min(reach, p.width); ++x)
+        filter_pixel(p, x, y);
+    for (; x + 3 + reach < p.width; x += 4)
+        filter_pixels(p, x, y);
+#endif
+    for (; x < p.width; ++x)
+        filter_pixel(p, x, y);
+}
+
+// Rows handed out one at a time, like the bands of a batch
+template <class F>
+void parallel_rows(int rows, int threads, F&& f)
+{
+    threads = std::clamp(threads, 1, rows);
+    if (threads == 1)
+    {
+        for (int y = 0; y < rows; ++y)
+            f(y);
+        return;
+    }
+
+    std::atomic<int> next = 0;
+    std::vector<std::thread> pool;
+    for (int t = 0; t < threads; ++t)
+    {
+        pool.emplace_back(
+            [&]
+            {
+                for (int y = next++; y < rows; y = next++)
+                    f(y);
+            });
+    }
+    for (auto& thread : pool)
+        thread.join();
+}
+
+} // namespace
+
+void denoise(std::vector<glm::vec3>& image, const guide_image& guides, int width, int height,
+             const denoise_settings& settings, int threads)
+{
+    const std::size_t pixels = (std::size_t)width * height;
+    channels lighting[2] = {channels(pixels), channels(pixels)};
+    channels albedo(pixels), normal(pixels);
+
+    for (std::size_t i = 0; i < pixels; ++i)
+    {
+        for (int ch = 0; ch < 3; ++ch)
+        {
+            float a = std::max(guides.albedo[i][ch], albedo_floor);
+            lighting[0].c[ch][i] = image[i][ch] / a;
+            albedo.c[ch][i] = a;
+            normal.c[ch][i] = guides.normal[i][ch];
+        }
+    }
+
+    int from = 0;
+    for (int i = 0; i < settings.iterations; ++i, from = 1 - from)
+    {
+        const float color_sigma = std::ldexp(settings.color_sigma, -i);
+        pass p = {
+            width,
+            height,
+            1 << i,
+            1.f / (color_sigma * color_sigma),
+            1.f / (settings.albedo_sigma * settings.albedo_sigma),
+            1.f / (settings.normal_sigma * settings.normal_sigma),
+            settings.depth_sigma,
+            {lighting[from].c[0].data(), lighting[from].c[1].data(), lighting[from].c[2].data()},
+            {lighting[1 - from].c[0].data(), lighting[1 - from].c[1].data(),
+             lighting[1 - from].c[2].data()},
+            {albedo.c[0].data(), albedo.c[1].data(), albedo.c[2].data()},
+            {normal.c[0].data(), normal.c[1].data(), normal.c[2].data()},
+            guides.depth.data(),
+        };
+        parallel_rows(height, threads, [&](int y) { filter_row(p, y); });
+    }
+
+    for (std::size_t i = 0; i < pixels; ++i)
+        for (int ch = 0; ch < 3; ++ch)
+            image[i][ch] = lighting[from].c[ch][i] * albedo.c[ch][i];
+}
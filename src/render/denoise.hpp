@@ -0,0 +1,47 @@
+// Ray tracing with a cone tree
+// Copyright © 2022 otreblan
+//
+// cone-tree is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// cone-tree is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with cone-tree.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#pragma once
+
+#include <vector>
+
+#include <glm/vec3.hpp>
+
+#include "render.hpp"
+
+// How far apart two pixels can be in every guide before they stop being averaged together. The
+// filter weighs a neighbour by exp(-sum of (difference / sigma)²).
+struct denoise_settings
+{
+    // Passes of the 5x5 filter, every one spreads its taps twice as far apart as the one before,
+    // so 5 passes reach 62 pixels away
+    int iterations = 5;
+    // Lighting, halved every pass since the earlier ones have already smoothed it
+    float color_sigma = 1.f;
+    float albedo_sigma = 0.1f;
+    float normal_sigma = 0.3f;
+    // Relative to the depth of the pixel being filtered
+    float depth_sigma = 0.05f;
+};
+
+// Edge avoiding à-trous wavelet filter (Dammertz et al. 2010) guided by the first hits. image
+// and guides hold averages, the image is filtered in place. The color is divided by the albedo
+// before filtering and multiplied back after, so only the lighting gets blurred and textures and
+// material edges stay sharp. Every pass reads one copy of the image and writes the other, split
+// by rows between threads, so the result doesn't depend on their number.
+void denoise(std::vector<glm::vec3>& image, const guide_image& guides, int width, int height,
+             const denoise_settings& settings, int threads);
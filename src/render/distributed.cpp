@@ -0,0 +1,288 @@
+// Ray tracing with a cone tree
+// Copyright © 2022 otreblan
+//
+// cone-tree is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// cone-tree is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with cone-tree.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "distributed.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <stdexcept>
+
+#include <fmt/core.h>
+#include <poll.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "../net/socket.hpp"
+#include "../rtx/rtweekend.hpp"
+
+namespace
+{
+
+constexpr std::uint32_t protocol_magic = 0x636f6e65; // "cone"
+
+// Coordinator to worker, once per connection
+struct job_message
+{
+    std::uint32_t magic;
+    render_settings settings;
+    camera cam;
+};
+
+// Coordinator to worker, zero rows means the frame is done
+struct unit_message
+{
+    std::int32_t first_row;
+    std::int32_t rows;
+};
+
+// Worker to coordinator, followed by the rows of samples
+struct result_header
+{
+    std::int32_t first_row;
+    std::int32_t rows;
+    path_stats paths;
+};
+
+struct connection
+{
+    int fd;
+    int unit = -1; // In flight, -1 when idle
+    int rows = 0;  // Of the band in flight
+};
+
+} // namespace
+
+static unsigned band_seed(int first_row) { return 0x9e3779b9u * (unsigned)(first_row + 1); }
+
+void run_worker(const scene& world, const std::string& address)
+{
+    int fd = connect_to(address);
+    job_message job;
+    if (!receive_all(fd, &job, sizeof(job)) || job.magic != protocol_magic)
+    {
+        close(fd);
+        throw std::runtime_error("The coordinator at " + address + " didn't send a job");
+    }
+
+    const int width = job.settings.width;
+    std::vector<glm::vec3> block;
+    unit_message unit;
+    while (receive_all(fd, &unit, sizeof(unit)) && unit.rows > 0)
+    {
+        block.assign((std::size_t)unit.rows * width, glm::vec3(0.f));
+        seed_random(band_seed(unit.first_row));
+        result_header header = {unit.first_row, unit.rows, {}};
+        header.paths = render_rows(world, job.cam, job.settings, unit.first_row, unit.rows, block);
+
+        send_all(fd, &header, sizeof(header));
+        send_all(fd, block.data(), block.size() * sizeof(glm::vec3));
+    }
+    close(fd);
+}
+
+distributed_stats render_distributed(const scene& world, const camera& cam,
+                                     const render_settings& settings,
+                                     const distributed_settings& distributed,
+                                     std::vector<glm::vec3>& image)
+{
+    if (distributed.local_workers < 1 && distributed.listen.empty())
+        throw std::runtime_error("A distributed render needs local workers or an address");
+
+    std::string bound;
+    int listener = listen_on(distributed.listen.empty() ? "127.0.0.1:0" : distributed.listen,
+                             bound);
+    if (!distributed.listen.empty())
+        fmt::print(stderr, "Waiting for workers on {}\n", bound);
+
+    // The children get the frozen scene for free, copy on write
+    std::vector<pid_t> children;
+    std::fflush(nullptr);
+    for (int w = 0; w < distributed.local_workers; w++)
+    {
+        pid_t pid = fork();
+        if (pid < 0)
+            throw std::runtime_error("Failed to start a worker");
+        if (pid == 0)
+        {
+            close(listener);
+            int status = EXIT_SUCCESS;
+            try
+            {
+                run_worker(world, bound);
+            }
+            catch (const std::exception& e)
+            {
+                fmt::print(stderr, "Worker {}: {}\n", w, e.what());
+                status = EXIT_FAILURE;
+            }
+            // Leave the buffers and destructors of the parent alone
+            _exit(status);
+        }
+        children.push_back(pid);
+    }
+
+    const int rows = std::max(distributed.rows_per_unit, 1);
+    std::deque<int> pending;
+    for (int first_row = 0; first_row < settings.height; first_row += rows)
+        pending.push_back(first_row);
+
+    distributed_stats stats;
+    std::vector<connection> workers;
+    const job_message job = {protocol_magic, settings, cam};
+    std::vector<glm::vec3> block;
+
+    // Gives the next band to an idle worker, false if it went away
+    auto assign = [&](connection& worker)
+    {
+        if (pending.empty())
+            return true;
+        int first_row = pending.front();
+        unit_message unit = {first_row, std::min(rows, settings.height - first_row)};
+        try
+        {
+            send_all(worker.fd, &unit, sizeof(unit));
+        }
+        catch (const std::runtime_error&)
+        {
+            return false;
+        }
+        pending.pop_front();
+        worker.unit = first_row;
+        worker.rows = unit.rows;
+        return true;
+    };
+    auto drop = [&](std::size_t w)
+    {
+        if (workers[w].unit >= 0)
+        {
+            pending.push_front(workers[w].unit);
+            stats.retried++;
+        }
+        close(workers[w].fd);
+        workers.erase(workers.begin() + (std::ptrdiff_t)w);
+    };
+    auto in_flight = [&]
+    {
+        return std::any_of(workers.begin(), workers.end(),
+                           [](const connection& c) { return c.unit >= 0; });
+    };
+
+    std::vector<pollfd> fds;
+    while (!pending.empty() || in_flight())
+    {
+        // Only local workers and every one of them gone, nobody else is coming
+        if (workers.empty() && distributed.listen.empty())
+        {
+            std::erase_if(children, [](pid_t child)
+                          { return waitpid(child, nullptr, WNOHANG) == child; });
+            if (children.empty())
+                throw std::runtime_error("Every worker went away before the frame was done");
+        }
+
+        fds.assign(1, {listener, POLLIN, 0});
+        for (const connection& worker : workers)
+            fds.push_back({worker.fd, POLLIN, 0});
+        // Wakes up now and then to notice workers that died before connecting
+        if (poll(fds.data(), fds.size(), 1000) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            throw std::runtime_error("Failed to wait for the workers");
+        }
+
+        // Backwards, so dropping a worker doesn't move the ones still to check
+        for (std::size_t w = workers.size(); w-- > 0;)
+        {
+            if (!fds[w + 1].revents)
+                continue;
+
+            result_header header;
+            try
+            {
+                // Anything but the band it was given, say from another build, would be added
+                // outside of it
+                if (!receive_all(workers[w].fd, &header, sizeof(header)) ||
+                    header.first_row != workers[w].unit || header.rows != workers[w].rows)
+                {
+                    drop(w);
+                    continue;
+                }
+                block.resize((std::size_t)header.rows * settings.width);
+                if (!receive_all(workers[w].fd, block.data(), block.size() * sizeof(glm::vec3)))
+                {
+                    drop(w);
+                    continue;
+                }
+            }
+            catch (const std::runtime_error&)
+            {
+                drop(w);
+                continue;
+            }
+
+            auto* out = image.data() + (std::size_t)header.first_row * settings.width;
+            for (std::size_t k = 0; k < block.size(); ++k)
+                out[k] += block[k];
+            stats.paths += header.paths;
+            stats.units++;
+            workers[w].unit = -1;
+            if (!assign(workers[w]))
+                drop(w);
+        }
+
+        if (fds[0].revents & POLLIN)
+        {
+            connection worker = {accept_from(listener)};
+            stats.workers++;
+            try
+            {
+                send_all(worker.fd, &job, sizeof(job));
+                workers.push_back(worker);
+            }
+            catch (const std::runtime_error&)
+            {
+                close(worker.fd);
+                continue;
+            }
+            if (!assign(workers.back()))
+                drop(workers.size() - 1);
+        }
+    }
+
+    const unit_message done = {0, 0};
+    for (const connection& worker : workers)
+    {
+        try
+        {
+            send_all(worker.fd, &done, sizeof(done));
+        }
+        catch (const std::runtime_error&)
+        {
+        }
+        close(worker.fd);
+    }
+    close(listener);
+    if (bound.rfind("unix:", 0) == 0)
+        unlink(bound.c_str() + 5);
+
+    for (pid_t child : children)
+        waitpid(child, nullptr, 0);
+    return stats;
+}
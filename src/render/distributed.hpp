@@ -0,0 +1,55 @@
+// Ray tracing with a cone tree
+// Copyright © 2022 otreblan
+//
+// cone-tree is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// cone-tree is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with cone-tree.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <glm/vec3.hpp>
+
+#include "../rtx/camera.hpp"
+#include "../scene/scene.hpp"
+#include "render.hpp"
+
+struct distributed_settings
+{
+    int local_workers = 0; // Forked from this process once the scene is frozen
+    std::string listen;    // Where remote workers connect, empty when there are only local ones
+    int rows_per_unit = 8; // Rows handed out at a time
+};
+
+struct distributed_stats
+{
+    int workers = 0; // Connections accepted
+    int units = 0;
+    int retried = 0; // Units handed out again because their worker went away
+    path_stats paths;
+};
+
+// Same result as render() in distribution, but the frame is cut in bands of rows that worker
+// processes ask for one at a time, so faster workers take more of them. Bands are added back into
+// image as they arrive. Every band reseeds the random numbers from its first row, so the image
+// doesn't depend on the number of workers or on which one rendered what. Workers must run the
+// same build with the same scene, messages are sent as they are in memory.
+distributed_stats render_distributed(const scene& world, const camera& cam,
+                                     const render_settings& settings,
+                                     const distributed_settings& distributed,
+                                     std::vector<glm::vec3>& image);
+
+// Connects to a coordinator and renders the bands it sends until it says the frame is done
+void run_worker(const scene& world, const std::string& address);
@@ -0,0 +1,74 @@
+// Ray tracing with a cone tree
+// Copyright © 2022 otreblan
+//
+// cone-tree is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// cone-tree is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with cone-tree.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "heatmap.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#include <fmt/core.h>
+
+#include "../stats.hpp"
+#include "image_output.hpp"
+
+heatmap render_heatmap(const scene& world, const camera& cam, int width, int height)
+{
+    heatmap map{width, height, {}, {}};
+    map.nodes.resize(width * height);
+    map.primitives.resize(width * height);
+
+    auto& stats = local_traversal_stats();
+    for (int j = 0; j < height; ++j)
+    {
+        for (int i = 0; i < width; ++i)
+        {
+            float u = (i + 0.5f) / (width - 1);
+            float v = (j + 0.5f) / (height - 1);
+
+            hit_record rec;
+            auto before = stats;
+            world.hit(cam.get_ray(u, v), 0.001f, HUGE_VALF, rec);
+            auto cost = stats - before;
+
+            map.nodes[i + j * width] = cost.nodes;
+            map.primitives[i + j * width] = cost.primitives;
+        }
+    }
+    return map;
+}
+
+void write_heatmap(std::FILE* file, const heatmap& map, std::uint32_t max_nodes,
+                   std::uint32_t max_primitives)
+{
+    if (max_nodes == 0)
+        max_nodes = std::max(1u, *std::max_element(map.nodes.begin(), map.nodes.end()));
+    if (max_primitives == 0)
+        max_primitives =
+            std::max(1u, *std::max_element(map.primitives.begin(), map.primitives.end()));
+
+    fmt::print(stderr, "Heatmap scale: {} nodes, {} primitives\n", max_nodes, max_primitives);
+
+    auto level = [](std::uint32_t value, std::uint32_t max)
+    { return (std::uint8_t)(255.f * std::min(1.f, (float)value / (float)max)); };
+
+    std::vector<std::uint8_t> rgb(3 * map.nodes.size());
+    for (std::size_t idx = 0; idx < map.nodes.size(); ++idx)
+    {
+        rgb[3 * idx] = level(map.primitives[idx], max_primitives);
+        rgb[3 * idx + 1] = level(map.nodes[idx], max_nodes);
+    }
+    write_ppm(file, rgb, map.width, map.height);
+}
@@ -0,0 +1,41 @@
+// Ray tracing with a cone tree
+// Copyright © 2022 otreblan
+//
+// cone-tree is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// cone-tree is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with cone-tree.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+#include "../rtx/camera.hpp"
+#include "../scene/scene.hpp"
+
+// Traversal cost of the primary ray through the center of every pixel, rows bottom to top like
+// the beauty image. Needs a build with CONE_TREE_STATS, the counters are zero otherwise.
+struct heatmap
+{
+    int width = 0;
+    int height = 0;
+    std::vector<std::uint32_t> nodes;
+    std::vector<std::uint32_t> primitives;
+};
+
+heatmap render_heatmap(const scene& world, const camera& cam, int width, int height);
+
+// Primitive tests go to the red channel and visited nodes to the green one, each scaled so the
+// given maximum (or the image maximum when zero) is full intensity.
+void write_heatmap(std::FILE* file, const heatmap& map, std::uint32_t max_nodes = 0,
+                   std::uint32_t max_primitives = 0);
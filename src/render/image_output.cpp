@@ -0,0 +1,248 @@
+// Ray tracing with a cone tree
+// Copyright © 2022 otreblan
+//
+// cone-tree is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// cone-tree is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with cone-tree.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "image_output.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include <fmt/format.h>
+
+#include "../print.hpp"
+
+static_assert(std::endian::native == std::endian::little,
+              "PFM and EXR are written straight from memory as little endian");
+
+namespace
+{
+
+using byte_buffer = std::vector<char>;
+
+// Same mapping as the sampled_color formatter: scale, gamma 2 and quantize
+void to_bytes(const float* in, std::uint8_t* out, std::size_t n, float scale)
+{
+    for (std::size_t k = 0; k < n; ++k)
+    {
+        float v = std::sqrt(std::max(in[k] * scale, 0.f));
+        out[k] = (std::uint8_t)(256.f * std::min(v, 0.999f));
+    }
+}
+
+const float* row(const std::vector<glm::vec3>& image, int width, int j)
+{
+    return &image[(std::size_t)j * width].x;
+}
+
+template <class T>
+void append(byte_buffer& buffer, const T& value)
+{
+    const char* bytes = reinterpret_cast<const char*>(&value);
+    buffer.insert(buffer.end(), bytes, bytes + sizeof(T));
+}
+
+void append(byte_buffer& buffer, std::string_view text)
+{
+    buffer.insert(buffer.end(), text.begin(), text.end());
+    buffer.push_back('\0');
+}
+
+void flush(std::FILE* file, const char* data, std::size_t size)
+{
+    if (std::fwrite(data, 1, size, file) != size || std::fflush(file) != 0)
+        throw std::runtime_error("Failed to write image");
+}
+
+std::string ppm_header(int width, int height)
+{
+    return fmt::format("P6\n{} {}\n255\n", width, height);
+}
+
+void write_p3(std::FILE* file, const std::vector<glm::vec3>& image, int width, int height,
+              float scale)
+{
+    // sampled_color wants a sample count, not a scale
+    const int samples = (int)std::lround(1.f / scale);
+
+    fmt::memory_buffer buffer;
+    fmt::format_to(std::back_inserter(buffer), "P3\n{} {}\n255\n", width, height);
+    for (int j = height - 1; j >= 0; --j)
+        for (int i = 0; i < width; ++i)
+            fmt::format_to(std::back_inserter(buffer), "{}\n",
+                           sampled_color(image[i + j * width], samples));
+    flush(file, buffer.data(), buffer.size());
+}
+
+void write_p6(std::FILE* file, const std::vector<glm::vec3>& image, int width, int height,
+              float scale)
+{
+    const auto header = ppm_header(width, height);
+    const std::size_t row_bytes = 3 * (std::size_t)width;
+
+    std::vector<std::uint8_t> buffer(header.size() + row_bytes * height);
+    std::memcpy(buffer.data(), header.data(), header.size());
+
+    auto* out = buffer.data() + header.size();
+    for (int j = height - 1; j >= 0; --j, out += row_bytes)
+        to_bytes(row(image, width, j), out, row_bytes, scale);
+
+    flush(file, reinterpret_cast<const char*>(buffer.data()), buffer.size());
+}
+
+void write_pfm(std::FILE* file, const std::vector<glm::vec3>& image, int width, int height,
+               float scale)
+{
+    // Negative scale means little endian, rows already go bottom to top
+    const auto header = fmt::format("PF\n{} {}\n-1.0\n", width, height);
+
+    byte_buffer buffer(header.begin(), header.end());
+    buffer.reserve(header.size() + image.size() * sizeof(glm::vec3));
+    for (const auto& pixel : image)
+        append(buffer, pixel * scale);
+
+    flush(file, buffer.data(), buffer.size());
+}
+
+void write_exr(std::FILE* file, const std::vector<glm::vec3>& image, int width, int height,
+               float scale)
+{
+    byte_buffer buffer;
+
+    // Magic number and version 2, single part scanline file
+    append(buffer, std::int32_t(20000630));
+    append(buffer, std::int32_t(2));
+
+    auto attribute = [&](std::string_view name, std::string_view type, std::int32_t size)
+    {
+        append(buffer, name);
+        append(buffer, type);
+        append(buffer, size);
+    };
+
+    // Channels must be sorted by name
+    constexpr std::string_view channels[] = {"B", "G", "R"};
+    attribute("channels", "chlist", 3 * (2 + 16) + 1);
+    for (auto channel : channels)
+    {
+        append(buffer, channel);
+        append(buffer, std::int32_t(2)); // FLOAT
+        append(buffer, std::int32_t(0)); // pLinear and reserved
+        append(buffer, std::int32_t(1)); // xSampling
+        append(buffer, std::int32_t(1)); // ySampling
+    }
+    buffer.push_back('\0');
+
+    attribute("compression", "compression", 1);
+    buffer.push_back(0); // NO_COMPRESSION
+
+    for (auto window : {"dataWindow", "displayWindow"})
+    {
+        attribute(window, "box2i", 16);
+        append(buffer, std::int32_t(0));
+        append(buffer, std::int32_t(0));
+        append(buffer, std::int32_t(width - 1));
+        append(buffer, std::int32_t(height - 1));
+    }
+
+    attribute("lineOrder", "lineOrder", 1);
+    buffer.push_back(0); // INCREASING_Y
+
+    attribute("pixelAspectRatio", "float", 4);
+    append(buffer, 1.f);
+
+    attribute("screenWindowCenter", "v2f", 8);
+    append(buffer, 0.f);
+    append(buffer, 0.f);
+
+    attribute("screenWindowWidth", "float", 4);
+    append(buffer, 1.f);
+
+    buffer.push_back('\0');
+
+    // One scanline per block, EXR rows go top to bottom
+    const std::int32_t line_bytes = 3 * width * sizeof(float);
+    const std::uint64_t first_line = buffer.size() + height * sizeof(std::uint64_t);
+    for (int y = 0; y < height; ++y)
+        append(buffer, std::uint64_t(first_line + (std::uint64_t)y * (8 + line_bytes)));
+
+    buffer.reserve(buffer.size() + (std::size_t)height * (8 + line_bytes));
+    for (int y = 0; y < height; ++y)
+    {
+        append(buffer, std::int32_t(y));
+        append(buffer, line_bytes);
+
+        const int j = height - 1 - y;
+        for (int channel = 2; channel >= 0; --channel)
+            for (int i = 0; i < width; ++i)
+                append(buffer, image[i + j * width][channel] * scale);
+    }
+
+    flush(file, buffer.data(), buffer.size());
+}
+
+} // namespace
+
+image_format parse_image_format(std::string_view name)
+{
+    if (name == "p3")
+        return image_format::p3;
+    else if (name == "p6")
+        return image_format::p6;
+    else if (name == "pfm")
+        return image_format::pfm;
+    else if (name == "exr")
+        return image_format::exr;
+
+    throw std::runtime_error("Unknown image format: \"" + std::string(name) + "\"");
+}
+
+bool is_binary(image_format format) { return format != image_format::p3; }
+
+void write_image(std::FILE* file, image_format format, const std::vector<glm::vec3>& image,
+                 int width, int height, float scale)
+{
+    switch (format)
+    {
+        case image_format::p3:
+            write_p3(file, image, width, height, scale);
+            break;
+        case image_format::p6:
+            write_p6(file, image, width, height, scale);
+            break;
+        case image_format::pfm:
+            write_pfm(file, image, width, height, scale);
+            break;
+        case image_format::exr:
+            write_exr(file, image, width, height, scale);
+            break;
+    }
+}
+
+void write_ppm(std::FILE* file, const std::vector<std::uint8_t>& rgb, int width, int height)
+{
+    const auto header = ppm_header(width, height);
+    const std::size_t row_bytes = 3 * (std::size_t)width;
+
+    std::vector<std::uint8_t> buffer(header.begin(), header.end());
+    buffer.reserve(header.size() + rgb.size());
+    for (int j = height - 1; j >= 0; --j)
+        buffer.insert(buffer.end(), rgb.begin() + j * row_bytes, rgb.begin() + (j + 1) * row_bytes);
+
+    flush(file, reinterpret_cast<const char*>(buffer.data()), buffer.size());
+}
@@ -0,0 +1,49 @@
+// Ray tracing with a cone tree
+// Copyright © 2022 otreblan
+//
+// cone-tree is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// cone-tree is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with cone-tree.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <string_view>
+#include <vector>
+
+#include <glm/vec3.hpp>
+
+// p3:  ASCII PPM, the old output.
+// p6:  binary PPM, gamma corrected 8 bit.
+// pfm: portable float map, linear.
+// exr: uncompressed scanline OpenEXR, linear 32 bit float.
+enum class image_format
+{
+    p3,
+    p6,
+    pfm,
+    exr,
+};
+
+image_format parse_image_format(std::string_view name);
+
+// Text formats can go to a terminal, the rest shouldn't
+bool is_binary(image_format format);
+
+// Pixels are stored bottom row first and multiplied by scale (1/samples) while converting.
+// Every format is assembled in memory and handed to the file with a single write.
+void write_image(std::FILE* file, image_format format, const std::vector<glm::vec3>& image,
+                 int width, int height, float scale = 1.f);
+
+// Already quantized RGB bytes, also bottom row first
+void write_ppm(std::FILE* file, const std::vector<std::uint8_t>& rgb, int width, int height);
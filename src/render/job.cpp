@@ -0,0 +1,110 @@
+// Ray tracing with a cone tree
+// Copyright © 2022 otreblan
+//
+// cone-tree is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// cone-tree is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with cone-tree.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "job.hpp"
+
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+#include <glm/geometric.hpp>
+#include <glm/trigonometric.hpp>
+
+camera render_job::make_camera() const
+{
+    return camera::pointing(from, to, glm::radians(fov),
+                            (float)settings.width / (float)settings.height, 1.0f);
+}
+
+static glm::vec3 parse_vec3(const std::string& value)
+{
+    glm::vec3 v;
+    char comma1 = 0, comma2 = 0;
+    std::istringstream iss(value);
+    if (!(iss >> v.x >> comma1 >> v.y >> comma2 >> v.z) || comma1 != ',' || comma2 != ',' ||
+        !iss.eof())
+        throw std::runtime_error("Expected X,Y,Z, got \"" + value + "\"");
+    return v;
+}
+
+static int parse_positive(const std::string& key, const std::string& value)
+{
+    std::size_t used = 0;
+    int n = std::stoi(value, &used);
+    if (used != value.size() || n < 1)
+        throw std::runtime_error(key + " must be a positive integer, got \"" + value + "\"");
+    return n;
+}
+
+void parse_job(std::string_view words, render_job& job)
+{
+    std::istringstream iss{std::string(words)};
+    std::string word;
+    while (iss >> word)
+    {
+        auto equals = word.find('=');
+        if (equals == std::string::npos)
+            throw std::runtime_error("Expected key=value, got \"" + word + "\"");
+        std::string key = word.substr(0, equals), value = word.substr(equals + 1);
+
+        try
+        {
+            if (key == "from")
+                job.from = parse_vec3(value);
+            else if (key == "to")
+                job.to = parse_vec3(value);
+            else if (key == "fov")
+                job.fov = std::stof(value);
+            else if (key == "width")
+                job.settings.width = parse_positive(key, value);
+            else if (key == "height")
+                job.settings.height = parse_positive(key, value);
+            else if (key == "samples")
+                job.settings.samples_per_pixel = parse_positive(key, value);
+            else if (key == "depth")
+                job.settings.max_depth = parse_positive(key, value);
+            else if (key == "sampler")
+                job.settings.sampler = parse_sampler_type(value);
+            else if (key == "format")
+                job.format = parse_image_format(value);
+            else if (key == "seed")
+                job.seed = (unsigned)std::stoul(value);
+            else
+                throw std::runtime_error("Unknown key: \"" + key + "\"");
+        }
+        catch (const std::logic_error&)
+        {
+            // What std::stoi and friends throw
+            throw std::runtime_error("Bad value for " + key + ": \"" + value + "\"");
+        }
+    }
+
+    if (job.from == job.to)
+        throw std::runtime_error("The camera must look somewhere other than where it is");
+    // The camera takes +Y as up, so it can't look straight up or down
+    glm::vec3 dir = job.to - job.from;
+    if (glm::length(glm::cross(dir, glm::vec3(0, 1, 0))) <= 1e-6f * glm::length(dir))
+        throw std::runtime_error("The camera can't look straight up or down");
+    if (!(job.fov > 0 && job.fov < 180))
+        throw std::runtime_error("fov must be between 0 and 180 degrees");
+    if ((long long)job.settings.width * job.settings.height > max_job_pixels)
+        throw std::runtime_error("The image can have at most " + std::to_string(max_job_pixels) +
+                                 " pixels");
+    if (job.settings.samples_per_pixel > max_job_samples)
+        throw std::runtime_error("At most " + std::to_string(max_job_samples) +
+                                 " samples per pixel");
+}
@@ -0,0 +1,52 @@
+// Ray tracing with a cone tree
+// Copyright © 2022 otreblan
+//
+// cone-tree is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// cone-tree is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with cone-tree.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#pragma once
+
+#include <random>
+#include <string_view>
+
+#include <glm/vec3.hpp>
+
+#include "../rtx/camera.hpp"
+#include "image_output.hpp"
+#include "render.hpp"
+
+// One image to render: where the camera is, how much to render and how to write it. The defaults
+// are the camera the program has always used.
+struct render_job
+{
+    glm::vec3 from{0.f, 0.f, 1.f};
+    glm::vec3 to{0.f, 0.f, -1.f};
+    float fov = 90.f; // Vertical, in degrees
+    render_settings settings;
+    image_format format = image_format::p6;
+    unsigned seed = std::mt19937::default_seed; // What a fresh process starts with
+
+    // With the aspect ratio of the image
+    [[nodiscard]] camera make_camera() const;
+};
+
+// Largest job parse_job() accepts, so a typo in a job can't take down a server with one huge
+// allocation. The image alone is 12 bytes per pixel.
+constexpr long long max_job_pixels = 1 << 26; // 8192x8192
+constexpr int max_job_samples = 1 << 16;
+
+// Changes the fields named by space separated key=value words: from=X,Y,Z to=X,Y,Z fov=DEGREES
+// width=N height=N samples=N depth=N sampler=SAMPLER format=FORMAT seed=N. Throws
+// std::runtime_error, also for an fov outside (0, 180) or a camera looking along the Y axis.
+void parse_job(std::string_view words, render_job& job);
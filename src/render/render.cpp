@@ -0,0 +1,296 @@
+// Ray tracing with a cone tree
+// Copyright © 2022 otreblan
+//
+// cone-tree is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// cone-tree is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with cone-tree.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "render.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <type_traits>
+
+#include <glm/geometric.hpp>
+#include <glm/gtx/compatibility.hpp>
+
+#include "../material/material.hpp"
+#include "../scene/visit_scene.hpp"
+
+void guide_image::assign(std::size_t pixels)
+{
+    albedo.assign(pixels, glm::vec3(0.f));
+    normal.assign(pixels, glm::vec3(0.f));
+    depth.assign(pixels, 0.f);
+}
+
+void guide_image::add(std::size_t pixel, const first_hit& hit)
+{
+    albedo[pixel] += hit.albedo;
+    normal[pixel] += hit.normal;
+    depth[pixel] += hit.depth;
+}
+
+void guide_image::divide(std::size_t pixel, float samples)
+{
+    albedo[pixel] /= samples;
+    normal[pixel] /= samples;
+    depth[pixel] /= samples;
+}
+
+glm::vec3 sky_color(const glm::vec3& direction)
+{
+    glm::vec3 unit_direction = glm::normalize(direction);
+    float t = 0.5f * (unit_direction.y + 1.f);
+    return glm::lerp(glm::vec3(1.f, 1.f, 1.f), glm::vec3(0.5f, 0.7f, 1.f), t);
+}
+
+bool russian_roulette(glm::vec3& throughput, float u)
+{
+    // The floor keeps dim paths from coming back as fireflies with a huge weight
+    float p = std::clamp(std::max({throughput.x, throughput.y, throughput.z}), 0.05f, 1.f);
+    if (u >= p)
+        return false;
+    throughput /= p;
+    return true;
+}
+
+// ray_color() with world as a World, so its hit() calls aren't virtual
+template <class World>
+static glm::vec3 trace(const ray& r, const World& world, const render_settings& settings,
+                       sample_stream& samples, path_stats& stats, first_hit* first)
+{
+    ray current = r;
+    glm::vec3 throughput(1.f);
+    stats.paths++;
+
+    bool guiding = first != nullptr;
+    glm::vec3 tint(1.f);
+    float distance = 0;
+
+    for (int depth = 0; depth < settings.max_depth; ++depth)
+    {
+        hit_record rec;
+        stats.rays++;
+        bool found = world.hit(current, 0.001f, HUGE_VALF, rec);
+        if (guiding && found)
+        {
+            const material& mat = world.materials[rec.mat_id];
+            distance += rec.t * glm::length(current.direction);
+            *first = {tint * albedo(mat), rec.normal, distance};
+            guiding = is_specular(mat);
+            tint *= albedo(mat);
+        }
+        else if (guiding)
+        {
+            *first = {tint * sky_color(current.direction), glm::vec3(0.f), sky_depth};
+            guiding = false;
+        }
+        if (!found)
+            return throughput * sky_color(current.direction);
+
+        ray scattered;
+        glm::vec3 attenuation;
+        samples.start_bounce(depth);
+        if (!scatter(world.materials[rec.mat_id], current, rec, samples, attenuation, scattered))
+            return glm::vec3(0.f);
+
+        throughput *= attenuation;
+        current = scattered;
+
+        if (depth + 1 >= settings.roulette_depth &&
+            !russian_roulette(throughput, samples.roulette()))
+            return glm::vec3(0.f);
+    }
+
+    return glm::vec3(0.f);
+}
+
+glm::vec3 ray_color(const ray& r, const scene& world, const render_settings& settings,
+                    sample_stream& samples, path_stats& stats, first_hit* first)
+{
+    return trace(r, world, settings, samples, stats, first);
+}
+
+// Sample number index of pixel (i, j), its first hit goes to guides[idx]
+using pixel_sampler = glm::vec3 (*)(const scene& world, const camera& cam, const sampler& sampler,
+                                    const render_settings& settings, int i, int j, int index,
+                                    path_stats& stats, guide_image* guides, std::size_t idx);
+
+// The pixel_sampler of a World, world must be one
+template <class World>
+static glm::vec3 sample_with(const scene& world, const camera& cam, const sampler& sampler,
+                             const render_settings& settings, int i, int j, int index,
+                             path_stats& stats, guide_image* guides, std::size_t idx)
+{
+    const auto& backend = static_cast<const World&>(world);
+
+    sample_stream samples(sampler, (std::uint32_t)(i + j * settings.width), (std::uint32_t)index);
+    float u = (i + samples.next()) / (settings.width - 1);
+    float v = (j + samples.next()) / (settings.height - 1);
+    ray r = cam.get_ray(u, v);
+
+    if (!guides)
+        return trace(r, backend, settings, samples, stats, nullptr);
+
+    first_hit first;
+    glm::vec3 color = trace(r, backend, settings, samples, stats, &first);
+    guides->add(idx, first);
+    return color;
+}
+
+// Picked once per render, with the backend of world. The call per sample is the only indirect
+// one, the path under it runs the backend's own hit() with the tree inlined.
+static pixel_sampler pixel_sampler_for(const scene& world)
+{
+    return visit_scene(world,
+                       [](const auto& backend) -> pixel_sampler
+                       { return &sample_with<std::remove_cvref_t<decltype(backend)>>; });
+}
+
+path_stats render(const scene& world, const camera& cam, const render_settings& settings,
+                  std::vector<glm::vec3>& image, guide_image* guides)
+{
+    return render_rows(world, cam, settings, 0, settings.height, image, guides);
+}
+
+path_stats render_rows(const scene& world, const camera& cam, const render_settings& settings,
+                       int first_row, int rows, std::vector<glm::vec3>& block,
+                       guide_image* guides)
+{
+    auto sampler = make_sampler(settings.sampler, settings.samples_per_pixel);
+    const pixel_sampler sample_pixel = pixel_sampler_for(world);
+    path_stats stats;
+    for (int j = first_row + rows - 1; j >= first_row; --j)
+        for (int i = 0; i < settings.width; ++i)
+            for (int s = 0; s < settings.samples_per_pixel; ++s)
+            {
+                std::size_t idx = i + (j - first_row) * settings.width;
+                block[idx] +=
+                    sample_pixel(world, cam, *sampler, settings, i, j, s, stats, guides, idx);
+            }
+    return stats;
+}
+
+path_stats render_pass(const scene& world, const camera& cam, const render_settings& settings,
+                       int pass, std::vector<glm::vec3>& image, guide_image* guides)
+{
+    auto sampler = make_sampler(settings.sampler, settings.samples_per_pixel);
+    const pixel_sampler sample_pixel = pixel_sampler_for(world);
+    path_stats stats;
+    for (int j = settings.height - 1; j >= 0; --j)
+        for (int i = 0; i < settings.width; ++i)
+        {
+            std::size_t idx = i + j * settings.width;
+            image[idx] +=
+                sample_pixel(world, cam, *sampler, settings, i, j, pass, stats, guides, idx);
+        }
+    return stats;
+}
+
+namespace
+{
+
+// Welford's running mean and variance of the pixel luminance
+struct pixel_estimate
+{
+    float mean = 0;
+    float m2 = 0;
+
+    void add(const glm::vec3& color, int n)
+    {
+        float l = glm::dot(color, glm::vec3(0.2126f, 0.7152f, 0.0722f));
+        float delta = l - mean;
+        mean += delta / (float)n;
+        m2 += delta * (l - mean);
+    }
+
+    // Standard error of the mean after the display gamma, d√x = dx / 2√x
+    [[nodiscard]] float error(int n) const
+    {
+        if (n < 2)
+            return HUGE_VALF;
+        float standard_error = std::sqrt(m2 / (float)(n - 1) / (float)n);
+        return standard_error / (2.f * std::sqrt(std::max(mean, 1e-4f)));
+    }
+};
+
+} // namespace
+
+adaptive_result render_adaptive(const scene& world, const camera& cam,
+                                const render_settings& settings, const adaptive_settings& adaptive,
+                                std::vector<glm::vec3>& image, std::vector<int>& counts,
+                                guide_image* guides)
+{
+    const int pixels = settings.width * settings.height;
+    const int max_samples = adaptive.max_samples > 0 ? adaptive.max_samples
+                                                     : 4 * settings.samples_per_pixel;
+    const int min_samples = std::clamp(adaptive.min_samples, 2, settings.samples_per_pixel);
+    const int batch = std::max(1, min_samples / 2);
+
+    adaptive_result result;
+    result.budget = (std::uint64_t)pixels * settings.samples_per_pixel;
+
+    std::vector<pixel_estimate> estimates(pixels);
+    counts.assign(pixels, 0);
+    auto sampler = make_sampler(settings.sampler, settings.samples_per_pixel);
+    const pixel_sampler sample_pixel = pixel_sampler_for(world);
+
+    // Samples of a pixel are numbered in the order they are taken, so every prefix is as evenly
+    // spread as the sampler allows
+    auto sample = [&](int idx, int n)
+    {
+        for (int s = 0; s < n; ++s)
+        {
+            auto color = sample_pixel(world, cam, *sampler, settings, idx % settings.width,
+                                      idx / settings.width, counts[idx], result.paths, guides,
+                                      idx);
+            image[idx] += color;
+            estimates[idx].add(color, ++counts[idx]);
+        }
+        result.samples += n;
+    };
+
+    for (int idx = pixels - 1; idx >= 0; --idx)
+        sample(idx, min_samples);
+
+    // Every round gives another batch to the pixels that are still noisy, the noisiest first
+    std::vector<int> active(pixels);
+    std::iota(active.begin(), active.end(), 0);
+    while (result.samples < result.budget)
+    {
+        std::erase_if(active,
+                      [&](int idx)
+                      {
+                          return counts[idx] >= max_samples ||
+                                 estimates[idx].error(counts[idx]) <= adaptive.threshold;
+                      });
+        if (active.empty())
+            break;
+
+        std::sort(active.begin(), active.end(),
+                  [&](int a, int b)
+                  { return estimates[a].error(counts[a]) > estimates[b].error(counts[b]); });
+
+        for (int idx : active)
+        {
+            auto left = result.budget - result.samples;
+            if (left == 0)
+                break;
+            sample(idx, (int)std::min<std::uint64_t>(
+                            {(std::uint64_t)batch, left, (std::uint64_t)(max_samples - counts[idx])}));
+        }
+    }
+
+    return result;
+}
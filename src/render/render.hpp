@@ -0,0 +1,136 @@
+// Ray tracing with a cone tree
+// Copyright © 2022 otreblan
+//
+// cone-tree is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// cone-tree is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with cone-tree.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <glm/vec3.hpp>
+
+#include "../rtx/camera.hpp"
+#include "../rtx/ray.hpp"
+#include "../rtx/sampler.hpp"
+#include "../scene/scene.hpp"
+
+struct render_settings
+{
+    int width = 800;
+    int height = 450;
+    int samples_per_pixel = 50;
+    int max_depth = 50;
+    // Bounces before paths start playing Russian roulette, max_depth or more turns it off
+    int roulette_depth = 3;
+    sampler_type sampler = sampler_type::random;
+};
+
+// Rays traced per camera path, how deep paths go on average
+struct path_stats
+{
+    std::uint64_t paths = 0;
+    std::uint64_t rays = 0;
+
+    path_stats& operator+=(const path_stats& other)
+    {
+        paths += other.paths;
+        rays += other.rays;
+        return *this;
+    }
+
+    [[nodiscard]] double average_length() const
+    {
+        return paths ? (double)rays / (double)paths : 0;
+    }
+};
+
+// The render keeps the budget of samples_per_pixel for every pixel, but pixels stop once the
+// standard error of their gamma corrected luminance drops below threshold and the rest of the
+// budget goes to the noisiest ones, up to max_samples each.
+struct adaptive_settings
+{
+    float threshold = 0.01f;
+    int min_samples = 8;
+    int max_samples = 0; // 0 means four times samples_per_pixel
+};
+
+struct adaptive_result
+{
+    std::uint64_t samples = 0;
+    std::uint64_t budget = 0;
+    path_stats paths;
+};
+
+// What the camera ray of a path hit, for the denoiser. Specular surfaces are looked through, to
+// the first other hit along the path: its albedo tinted by the mirrors on the way and the length
+// of the path up to it. Paths that escape see the sky: its color as albedo, no normal and
+// sky_depth.
+struct first_hit
+{
+    glm::vec3 albedo{0.f};
+    glm::vec3 normal{0.f};
+    float depth = 0; // Distance from the camera
+};
+
+constexpr float sky_depth = 1e6f;
+
+// Sums of the first hits of the samples of every pixel, laid out like the image they go with
+struct guide_image
+{
+    std::vector<glm::vec3> albedo;
+    std::vector<glm::vec3> normal;
+    std::vector<float> depth;
+
+    void assign(std::size_t pixels);
+    void add(std::size_t pixel, const first_hit& hit);
+
+    // Sums to averages
+    void divide(std::size_t pixel, float samples);
+};
+
+// Radiance of the background in a direction
+glm::vec3 sky_color(const glm::vec3& direction);
+
+// Past roulette_depth a path survives with probability equal to its brightest throughput
+// channel, and the survivors are weighted up so the expected value doesn't change. u is uniform
+// in [0, 1).
+bool russian_roulette(glm::vec3& throughput, float u);
+
+// Iterative, keeps the path throughput instead of multiplying on the way back up. samples is
+// past the camera dimensions. first, if given, receives what r hit.
+glm::vec3 ray_color(const ray& r, const scene& world, const render_settings& settings,
+                    sample_stream& samples, path_stats& stats, first_hit* first = nullptr);
+
+// Every sample of a pixel before moving to the next one. The image holds the sum of the
+// samples, bottom row first. Every render function also sums the first hits into guides, when
+// given one of the same size as the image.
+path_stats render(const scene& world, const camera& cam, const render_settings& settings,
+                  std::vector<glm::vec3>& image, guide_image* guides = nullptr);
+
+// Like render(), but only rows [first_row, first_row + rows) and block only holds those
+path_stats render_rows(const scene& world, const camera& cam, const render_settings& settings,
+                       int first_row, int rows, std::vector<glm::vec3>& block,
+                       guide_image* guides = nullptr);
+
+// Adds sample number pass to every pixel
+path_stats render_pass(const scene& world, const camera& cam, const render_settings& settings,
+                       int pass, std::vector<glm::vec3>& image, guide_image* guides = nullptr);
+
+// Like render(), but counts receives the samples taken by every pixel
+adaptive_result render_adaptive(const scene& world, const camera& cam,
+                                const render_settings& settings, const adaptive_settings& adaptive,
+                                std::vector<glm::vec3>& image, std::vector<int>& counts,
+                                guide_image* guides = nullptr);
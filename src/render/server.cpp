@@ -0,0 +1,220 @@
+// Ray tracing with a cone tree
+// Copyright © 2022 otreblan
+//
+// cone-tree is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// cone-tree is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with cone-tree.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "server.hpp"
+
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <string_view>
+
+#include <fmt/core.h>
+#include <unistd.h>
+
+#include "../net/socket.hpp"
+#include "../rtx/rtweekend.hpp"
+#include "../timer.hpp"
+
+namespace
+{
+
+// Lines of a descriptor, read in blocks
+class line_reader
+{
+public:
+    // Longer lines aren't kept, they come out empty and too_long() tells them apart
+    static constexpr std::size_t max_line = 64 << 10;
+
+    explicit line_reader(int fd) : fd(fd) {}
+
+    // False at the end of the stream
+    bool next(std::string& line)
+    {
+        while (true)
+        {
+            auto newline = buffer.find('\n', scanned);
+            if (newline != std::string::npos)
+            {
+                if (skipping)
+                    line.clear();
+                else
+                    line.assign(buffer, 0, newline);
+                last_too_long = skipping;
+                skipping = false;
+                buffer.erase(0, newline + 1);
+                scanned = 0;
+                return true;
+            }
+            scanned = buffer.size();
+            // What is left of the line is read and thrown away
+            if (scanned > max_line)
+            {
+                skipping = true;
+                buffer.clear();
+                scanned = 0;
+            }
+
+            char block[4096];
+            ssize_t got = read(fd, block, sizeof(block));
+            if (got < 0 && errno == EINTR)
+                continue;
+            if (got <= 0)
+            {
+                // A last line without a newline still counts
+                line = skipping ? std::string() : std::move(buffer);
+                last_too_long = skipping;
+                skipping = false;
+                buffer.clear();
+                scanned = 0;
+                return !line.empty() || last_too_long;
+            }
+            buffer.append(block, got);
+        }
+    }
+
+    // If the line next() returned was longer than max_line
+    [[nodiscard]] bool too_long() const { return last_too_long; }
+
+private:
+    int fd;
+    std::string buffer;
+    std::size_t scanned = 0; // Bytes of buffer already known to have no newline
+    bool skipping = false;   // Inside a line that is too long
+    bool last_too_long = false;
+};
+
+} // namespace
+
+static void write_all(int fd, const void* data, std::size_t bytes)
+{
+    const auto* next = static_cast<const char*>(data);
+    while (bytes > 0)
+    {
+        ssize_t written = write(fd, next, bytes);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            throw std::runtime_error(std::string("Failed to answer: ") + std::strerror(errno));
+        }
+        next += written;
+        bytes -= written;
+    }
+}
+
+static void write_line(int fd, const std::string& line)
+{
+    std::string terminated = line + "\n";
+    write_all(fd, terminated.data(), terminated.size());
+}
+
+// The image file as it would be written to disk
+static std::string render_job_image(const scene& world, const render_job& job)
+{
+    const render_settings& settings = job.settings;
+    std::vector<glm::vec3> image((std::size_t)settings.width * settings.height);
+    seed_random(job.seed);
+    render(world, job.make_camera(), settings, image);
+
+    char* data = nullptr;
+    std::size_t size = 0;
+    std::FILE* memory = open_memstream(&data, &size);
+    if (!memory)
+        throw std::runtime_error("Failed to allocate the image");
+    write_image(memory, job.format, image, settings.width, settings.height,
+                1.f / settings.samples_per_pixel);
+    std::fclose(memory);
+    std::string bytes(data, size);
+    std::free(data);
+    return bytes;
+}
+
+void serve_stream(const scene& world, const render_job& defaults, int in, int out)
+{
+    line_reader reader(in);
+    std::string line;
+    int jobs = 0;
+    while (reader.next(line))
+    {
+        if (reader.too_long())
+        {
+            write_line(out, "error Lines can be at most " +
+                                std::to_string(line_reader::max_line) + " bytes long");
+            continue;
+        }
+        std::string_view command = line;
+        auto space = command.find(' ');
+        std::string_view verb = command.substr(0, space);
+        std::string_view words = space == std::string_view::npos ? "" : command.substr(space);
+
+        if (verb.empty() || verb[0] == '#')
+            continue;
+        if (verb == "quit")
+            break;
+        if (verb != "render")
+        {
+            write_line(out, "error Unknown command: \"" + std::string(verb) + "\"");
+            continue;
+        }
+
+        std::string image;
+        Timer timer;
+        try
+        {
+            render_job job = defaults;
+            parse_job(words, job);
+            image = render_job_image(world, job);
+            fmt::print(stderr, "Job {}: {}x{}, {} samples, {:.1f}ms\n", ++jobs,
+                       job.settings.width, job.settings.height, job.settings.samples_per_pixel,
+                       1000 * timer.elapsed());
+        }
+        // Not only std::runtime_error, a job that runs out of memory mustn't end the session
+        catch (const std::exception& e)
+        {
+            write_line(out, std::string("error ") + e.what());
+            continue;
+        }
+        write_line(out, "ok " + std::to_string(image.size()));
+        write_all(out, image.data(), image.size());
+    }
+}
+
+void serve(const scene& world, const render_job& defaults, const std::string& address)
+{
+    // A client that leaves before its answer is written shouldn't stop the server
+    std::signal(SIGPIPE, SIG_IGN);
+
+    std::string bound;
+    int listener = listen_on(address, bound);
+    fmt::print(stderr, "Serving on {}\n", bound);
+    while (true)
+    {
+        int client = accept_from(listener);
+        try
+        {
+            serve_stream(world, defaults, client, client);
+        }
+        catch (const std::exception& e)
+        {
+            fmt::print(stderr, "Client dropped: {}\n", e.what());
+        }
+        close(client);
+    }
+}
@@ -0,0 +1,37 @@
+// Ray tracing with a cone tree
+// Copyright © 2022 otreblan
+//
+// cone-tree is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// cone-tree is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with cone-tree.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#pragma once
+
+#include <string>
+
+#include "../scene/scene.hpp"
+#include "job.hpp"
+
+// Keeps a frozen scene and renders jobs sent as lines of text:
+//
+//   render [key=value]...   one image, keys as in parse_job() on top of the defaults
+//   quit                    ends the session
+//
+// Every render is answered with "ok BYTES\n" and the image, or "error MESSAGE\n". Jobs render
+// with their own seed, so the same job always gives the same image.
+
+// One session over a pair of descriptors, such as stdin and stdout
+void serve_stream(const scene& world, const render_job& defaults, int in, int out);
+
+// Listens on address (unix:PATH or HOST:PORT) and serves one connection after another
+void serve(const scene& world, const render_job& defaults, const std::string& address);
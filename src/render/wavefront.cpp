@@ -0,0 +1,273 @@
+// Ray tracing with a cone tree
+// Copyright © 2022 otreblan
+//
+// cone-tree is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// cone-tree is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with cone-tree.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "wavefront.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <type_traits>
+#include <variant>
+
+#include "../material/material.hpp"
+#include "../rtx/ray_sort.hpp"
+#include "../scene/visit_scene.hpp"
+#include "../timer.hpp"
+
+void path_queue::resize(std::size_t n)
+{
+    origin.resize(n);
+    direction.resize(n);
+    throughput.resize(n);
+    pixel.resize(n);
+    sample.resize(n);
+    state.resize(n);
+    hit.resize(n);
+    found.resize(n);
+}
+
+void path_queue::sort()
+{
+    std::vector<std::uint32_t> order;
+    sort_rays(origin, direction, order);
+
+    std::vector<glm::vec3> scratch;
+    std::vector<int> pixel_scratch;
+    std::vector<std::uint32_t> sample_scratch;
+    permute(origin, order, scratch);
+    permute(direction, order, scratch);
+    permute(throughput, order, scratch);
+    permute(pixel, order, pixel_scratch);
+    permute(sample, order, sample_scratch);
+}
+
+// Paths are numbered pixel major, so the samples of a pixel stay together in the queue
+static void generate(const camera& cam, const sampler& sampler,
+                     const render_settings& settings, path_queue& queue, std::size_t first,
+                     std::size_t count)
+{
+    queue.resize(count);
+    for (std::size_t k = 0; k < count; ++k)
+    {
+        int idx = (int)((first + k) / settings.samples_per_pixel);
+        auto index = (std::uint32_t)((first + k) % settings.samples_per_pixel);
+        int i = idx % settings.width;
+        int j = idx / settings.width;
+
+        sample_stream samples(sampler, (std::uint32_t)idx, index);
+        float u = (i + samples.next()) / (settings.width - 1);
+        float v = (j + samples.next()) / (settings.height - 1);
+        ray r = cam.get_ray(u, v);
+
+        queue.origin[k] = r.origin;
+        queue.direction[k] = r.direction;
+        queue.throughput[k] = glm::vec3(1.f);
+        queue.pixel[k] = idx;
+        queue.sample[k] = index;
+        queue.state[k] = path_state::active;
+    }
+}
+
+// What scene::hit_batch() does, with world as a World so its hit() calls aren't virtual
+template <class World>
+static void hit_each(const World& world, path_queue& queue)
+{
+    for (std::size_t k = 0; k < queue.size(); ++k)
+        queue.found[k] = world.hit(ray(queue.origin[k], queue.direction[k]), 0.001f, HUGE_VALF,
+                                   queue.hit[k]);
+}
+
+static void extend(const scene& world, path_queue& queue)
+{
+    for (std::size_t k = 0; k < queue.size(); ++k)
+        queue.hit[k].t = HUGE_VALF;
+    visit_scene(world,
+                [&](const auto& backend)
+                {
+                    using World = std::remove_cvref_t<decltype(backend)>;
+                    // ooc needs the whole batch to group the rays by cluster
+                    if constexpr (std::is_same_v<World, scene_ooc> || std::is_same_v<World, scene>)
+                        backend.hit_batch(queue.origin.data(), queue.direction.data(),
+                                          queue.size(), 0.001f, HUGE_VALF, queue.hit.data(),
+                                          queue.found.data());
+                    else
+                        hit_each(backend, queue);
+                });
+}
+
+// Hits whose materials are all of type Material, a straight loop without dispatch
+template <class Material>
+static void shade_batch(path_queue& queue, const material_table& materials,
+                        const sampler& sampler, int depth, const std::size_t* first,
+                        const std::size_t* last, bool roulette)
+{
+    for (; first != last; ++first)
+    {
+        std::size_t k = *first;
+        const hit_record& rec = queue.hit[k];
+        const auto& mat = *std::get_if<Material>(&materials[rec.mat_id]);
+        ray scattered;
+        glm::vec3 attenuation;
+
+        sample_stream samples(sampler, (std::uint32_t)queue.pixel[k], queue.sample[k]);
+        samples.start_bounce(depth);
+        if (mat.scatter(ray(queue.origin[k], queue.direction[k]), rec, samples, attenuation,
+                        scattered))
+        {
+            queue.origin[k] = scattered.origin;
+            queue.direction[k] = scattered.direction;
+            queue.throughput[k] *= attenuation;
+
+            if (roulette && !russian_roulette(queue.throughput[k], samples.roulette()))
+                queue.state[k] = path_state::absorbed;
+        }
+        else
+            queue.state[k] = path_state::absorbed;
+    }
+}
+
+static void shade(path_queue& queue, const material_table& materials, const sampler& sampler,
+                  int depth, std::vector<std::size_t>& order, bool roulette)
+{
+    // Materials are few, so the hits are bucketed with a counting sort. Buckets follow the
+    // materials ordered by type, so every type ends up in one contiguous batch.
+    std::vector<material_id> by_type(materials.size());
+    std::iota(by_type.begin(), by_type.end(), 0);
+    std::stable_sort(by_type.begin(), by_type.end(), [&](material_id a, material_id b)
+                     { return materials[a].index() < materials[b].index(); });
+
+    std::vector<std::size_t> bucket(materials.size());
+    for (std::size_t rank = 0; rank < by_type.size(); ++rank)
+        bucket[by_type[rank]] = rank;
+
+    std::vector<std::size_t> offset(materials.size() + 1);
+    for (std::size_t k = 0; k < queue.size(); ++k)
+    {
+        if (queue.found[k])
+        {
+            offset[bucket[queue.hit[k].mat_id] + 1]++;
+            continue;
+        }
+
+        queue.throughput[k] *= sky_color(queue.direction[k]);
+        queue.state[k] = path_state::escaped;
+    }
+    std::partial_sum(offset.begin(), offset.end(), offset.begin());
+
+    order.resize(offset.back());
+    std::vector<std::size_t> next(offset.begin(), offset.end() - 1);
+    for (std::size_t k = 0; k < queue.size(); ++k)
+        if (queue.found[k])
+            order[next[bucket[queue.hit[k].mat_id]]++] = k;
+
+    // One dispatch per material type
+    for (std::size_t rank = 0; rank < by_type.size();)
+    {
+        std::size_t type = materials[by_type[rank]].index();
+        std::size_t end = rank;
+        while (end < by_type.size() && materials[by_type[end]].index() == type)
+            end++;
+
+        std::visit(
+            [&](const auto& mat)
+            {
+                using Material = std::decay_t<decltype(mat)>;
+                shade_batch<Material>(queue, materials, sampler, depth,
+                                      order.data() + offset[rank], order.data() + offset[end],
+                                      roulette);
+            },
+            materials[by_type[rank]]);
+        rank = end;
+    }
+}
+
+static void connect(path_queue& queue, std::vector<glm::vec3>& image)
+{
+    std::size_t alive = 0;
+    for (std::size_t k = 0; k < queue.size(); ++k)
+    {
+        switch (queue.state[k])
+        {
+            case path_state::escaped:
+                image[queue.pixel[k]] += queue.throughput[k];
+                break;
+            case path_state::absorbed:
+                break;
+            case path_state::active:
+                queue.origin[alive] = queue.origin[k];
+                queue.direction[alive] = queue.direction[k];
+                queue.throughput[alive] = queue.throughput[k];
+                queue.pixel[alive] = queue.pixel[k];
+                queue.sample[alive] = queue.sample[k];
+                queue.state[alive] = path_state::active;
+                alive++;
+                break;
+        }
+    }
+    queue.resize(alive);
+}
+
+wavefront_stats render_wavefront(const scene& world, const camera& cam,
+                                 const render_settings& settings,
+                                 const wavefront_settings& wavefront,
+                                 std::vector<glm::vec3>& image)
+{
+    wavefront_stats stats;
+    path_queue queue;
+    std::vector<std::size_t> order;
+    auto sampler = make_sampler(settings.sampler, settings.samples_per_pixel);
+    Timer timer;
+
+    const std::size_t paths =
+        (std::size_t)settings.width * settings.height * settings.samples_per_pixel;
+    const std::size_t batch = std::max<std::size_t>(wavefront.batch_size, 1);
+
+    for (std::size_t first = 0; first < paths; first += batch)
+    {
+        timer.reset();
+        generate(cam, *sampler, settings, queue, first, std::min(batch, paths - first));
+        stats.generate += timer.elapsed();
+        stats.paths.paths += queue.size();
+
+        // Paths still going after max_depth bounces are dropped, like ray_color does
+        for (int depth = 0; depth < settings.max_depth && !queue.empty(); ++depth)
+        {
+            if (wavefront.sort_secondary && depth > 0)
+            {
+                timer.reset();
+                queue.sort();
+                stats.sort += timer.elapsed();
+            }
+
+            timer.reset();
+            extend(world, queue);
+            stats.paths.rays += queue.size();
+            stats.extend += timer.elapsed();
+
+            timer.reset();
+            shade(queue, world.materials, *sampler, depth, order,
+                  depth + 1 >= settings.roulette_depth);
+            stats.shade += timer.elapsed();
+
+            timer.reset();
+            connect(queue, image);
+            stats.connect += timer.elapsed();
+        }
+    }
+
+    return stats;
+}
@@ -0,0 +1,85 @@
+// Ray tracing with a cone tree
+// Copyright © 2022 otreblan
+//
+// cone-tree is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// cone-tree is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with cone-tree.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <glm/vec3.hpp>
+
+#include "../rtx/camera.hpp"
+#include "../rtx/hit_record.hpp"
+#include "../scene/scene.hpp"
+#include "render.hpp"
+
+enum class path_state : std::uint8_t
+{
+    active,
+    escaped,
+    absorbed,
+};
+
+// Paths in flight, one array per field so every stage only streams through what it uses. All
+// paths in the queue are at the same bounce.
+struct path_queue
+{
+    std::vector<glm::vec3> origin;
+    std::vector<glm::vec3> direction;
+    std::vector<glm::vec3> throughput;
+    std::vector<int> pixel;
+    std::vector<std::uint32_t> sample; // Index inside the pixel, for the sampler
+    std::vector<path_state> state;
+    std::vector<hit_record> hit;
+    std::vector<std::uint8_t> found;
+
+    [[nodiscard]] std::size_t size() const { return pixel.size(); }
+    [[nodiscard]] bool empty() const { return pixel.empty(); }
+    void resize(std::size_t n);
+
+    // Sorts the live paths for coherent traversal, the hits are overwritten by extend anyway
+    void sort();
+};
+
+struct wavefront_settings
+{
+    // Paths generated at once, bounds the memory of the queue
+    std::size_t batch_size = 1 << 18;
+
+    // Reorder the queue by origin and direction before tracing every bounce after the first one
+    bool sort_secondary = false;
+};
+
+// Seconds spent in every stage and the rays traced by extend
+struct wavefront_stats
+{
+    double generate = 0;
+    double sort = 0;
+    double extend = 0;
+    double shade = 0;
+    double connect = 0;
+    path_stats paths;
+};
+
+// Same result as render(), but breadth first: batches of camera paths go through generate,
+// extend (closest hit of the whole queue), shade (grouped by material type) and connect (finished
+// paths go to the image, the rest are compacted) once per bounce.
+wavefront_stats render_wavefront(const scene& world, const camera& cam,
+                                 const render_settings& settings,
+                                 const wavefront_settings& wavefront,
+                                 std::vector<glm::vec3>& image);
@@ -0,0 +1,80 @@
+// Ray tracing with a cone tree
+// Copyright © 2022 otreblan
+//
+// cone-tree is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// cone-tree is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with cone-tree.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "ray_sort.hpp"
+
+#include <algorithm>
+#include <numeric>
+
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+
+#include "../math/aabb.hpp"
+
+// Spreads the lower 10 bits of x so there are two zero bits between each of them
+static std::uint32_t expand_bits(std::uint32_t x)
+{
+    x &= 0x3ff;
+    x = (x | (x << 16)) & 0x30000ff;
+    x = (x | (x << 8)) & 0x300f00f;
+    x = (x | (x << 4)) & 0x30c30c3;
+    x = (x | (x << 2)) & 0x9249249;
+    return x;
+}
+
+std::uint32_t morton(const glm::vec3& p, int bits)
+{
+    float cells = (float)(1 << bits);
+    glm::vec3 q = glm::clamp(p * cells, glm::vec3(0.f), glm::vec3(cells - 1.f));
+    return (expand_bits((std::uint32_t)q.x) << 2) | (expand_bits((std::uint32_t)q.y) << 1) |
+           expand_bits((std::uint32_t)q.z);
+}
+
+static std::uint64_t ray_key(const glm::vec3& origin, const glm::vec3& direction,
+                             const AABB& bounds)
+{
+    std::uint64_t octant = (direction.x < 0.f) << 2 | (direction.y < 0.f) << 1 |
+                           (direction.z < 0.f);
+
+    glm::vec3 extent = glm::max(bounds.max - bounds.min, glm::vec3(1e-6f));
+    std::uint64_t position = morton((origin - bounds.min) / extent, 10);
+
+    glm::vec3 unit = glm::normalize(direction) * 0.5f + 0.5f;
+    std::uint64_t heading = morton(unit, 6);
+
+    return octant << 48 | position << 18 | heading;
+}
+
+void sort_rays(const std::vector<glm::vec3>& origins, const std::vector<glm::vec3>& directions,
+               std::vector<std::uint32_t>& order)
+{
+    AABB bounds;
+    for (const auto& origin : origins)
+    {
+        bounds.min = glm::min(bounds.min, origin);
+        bounds.max = glm::max(bounds.max, origin);
+    }
+
+    std::vector<std::uint64_t> keys(origins.size());
+    for (std::size_t k = 0; k < origins.size(); ++k)
+        keys[k] = ray_key(origins[k], directions[k], bounds);
+
+    order.resize(origins.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(),
+              [&](std::uint32_t a, std::uint32_t b) { return keys[a] < keys[b]; });
+}
@@ -0,0 +1,45 @@
+// Ray tracing with a cone tree
+// Copyright © 2022 otreblan
+//
+// cone-tree is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// cone-tree is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with cone-tree.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/vec3.hpp>
+
+// Reordering of incoherent rays before traversal. The key puts the direction octant in the top
+// bits, then a Morton code of the origin inside the batch bounds and a coarse Morton code of the
+// direction, so consecutive rays start close together and point the same way.
+
+// 3 * bits wide code of a point in the unit cube, bits is at most 10
+std::uint32_t morton(const glm::vec3& p, int bits);
+
+// Order of the rays sorted by key, origins and directions have the same length
+void sort_rays(const std::vector<glm::vec3>& origins, const std::vector<glm::vec3>& directions,
+               std::vector<std::uint32_t>& order);
+
+// Applies order to one field of a structure of arrays, scratch avoids an allocation per field
+template <class T>
+void permute(std::vector<T>& values, const std::vector<std::uint32_t>& order,
+             std::vector<T>& scratch)
+{
+    scratch.resize(order.size());
+    for (std::size_t k = 0; k < order.size(); ++k)
+        scratch[k] = values[order[k]];
+    values.swap(scratch);
+}
@@ -0,0 +1,280 @@
+// Ray tracing with a cone tree
+// Copyright © 2022 otreblan
+//
+// cone-tree is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// cone-tree is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with cone-tree.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "sampler.hpp"
+
+#include <algorithm>
+#include <array>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "rtweekend.hpp"
+
+sampler_type parse_sampler_type(std::string_view name)
+{
+    if (name == "random")
+        return sampler_type::random;
+    else if (name == "stratified")
+        return sampler_type::stratified;
+    else if (name == "halton")
+        return sampler_type::halton;
+    else if (name == "sobol")
+        return sampler_type::sobol;
+
+    throw std::runtime_error("Unknown sampler: \"" + std::string(name) + "\"");
+}
+
+namespace
+{
+
+constexpr float one_minus_epsilon = 0x1.fffffep-1f;
+
+// Chris Wellons' lowbias32
+std::uint32_t hash(std::uint32_t x)
+{
+    x ^= x >> 16;
+    x *= 0x7feb352du;
+    x ^= x >> 15;
+    x *= 0x846ca68bu;
+    x ^= x >> 16;
+    return x;
+}
+
+std::uint32_t hash(std::uint32_t a, std::uint32_t b) { return hash(a ^ hash(b + 0x9e3779b9u)); }
+
+std::uint32_t hash(std::uint32_t a, std::uint32_t b, std::uint32_t c)
+{
+    return hash(hash(a, b), c);
+}
+
+// The top 24 bits, all a float in [0, 1) can hold
+float to_unit(std::uint32_t x) { return (float)(x >> 8) * 0x1p-24f; }
+
+// Kensler's hashed permutation of [0, n): a bijection on the bits up to n, repeated while the
+// result falls outside, then rotated
+std::uint32_t permute(std::uint32_t i, std::uint32_t n, std::uint32_t seed)
+{
+    std::uint32_t w = n - 1;
+    w |= w >> 1;
+    w |= w >> 2;
+    w |= w >> 4;
+    w |= w >> 8;
+    w |= w >> 16;
+    do
+    {
+        i ^= seed;
+        i *= 0xe170893du;
+        i ^= seed >> 16;
+        i ^= (i & w) >> 4;
+        i ^= seed >> 8;
+        i *= 0x0929eb3fu;
+        i ^= seed >> 23;
+        i ^= (i & w) >> 1;
+        i *= 1 | seed >> 27;
+        i *= 0x6935fa69u;
+        i ^= (i & w) >> 11;
+        i *= 0x74dcb303u;
+        i ^= (i & w) >> 2;
+        i *= 0x9e501cc3u;
+        i ^= (i & w) >> 2;
+        i *= 0xc860a3dfu;
+        i &= w;
+        i ^= i >> 5;
+    } while (i >= n);
+    return (i + seed) % n;
+}
+
+class random_sampler final : public sampler
+{
+public:
+    [[nodiscard]] float get(std::uint32_t, std::uint32_t, std::uint32_t) const override
+    {
+        return random_float();
+    }
+};
+
+class stratified_sampler final : public sampler
+{
+public:
+    explicit stratified_sampler(int strata) : strata((std::uint32_t)std::max(strata, 1)) {}
+
+    [[nodiscard]] float get(std::uint32_t pixel, std::uint32_t index,
+                            std::uint32_t dimension) const override
+    {
+        std::uint32_t seed = hash(pixel, dimension, index / strata);
+        std::uint32_t i = index % strata;
+        float jitter = to_unit(hash(seed, i));
+        return std::min(((float)permute(i, strata, seed) + jitter) / (float)strata,
+                        one_minus_epsilon);
+    }
+
+private:
+    std::uint32_t strata;
+};
+
+// Primes for the first dimensions, the rest get hashed values since the radical inverse in a
+// large base needs as many samples as the base before it covers [0, 1) at all
+const std::vector<std::uint32_t>& halton_bases()
+{
+    static const std::vector<std::uint32_t> bases = []
+    {
+        constexpr std::size_t count = 256;
+        std::vector<std::uint32_t> primes;
+        for (std::uint32_t n = 2; primes.size() < count; ++n)
+            if (std::none_of(primes.begin(), primes.end(), [n](std::uint32_t p)
+                             { return n % p == 0; }))
+                primes.push_back(n);
+        return primes;
+    }();
+    return bases;
+}
+
+class halton_sampler final : public sampler
+{
+public:
+    [[nodiscard]] float get(std::uint32_t pixel, std::uint32_t index,
+                            std::uint32_t dimension) const override
+    {
+        const auto& bases = halton_bases();
+        std::uint32_t seed = hash(pixel, dimension);
+        if (dimension >= bases.size())
+            return to_unit(hash(seed, index));
+
+        // Every digit position has its own permutation. The zeros past the last digit of the
+        // index are permuted too, up to float precision, or the points would all share the
+        // unscrambled tail.
+        const std::uint32_t base = bases[dimension];
+        const float inverse_base = 1.f / (float)base;
+        float value = 0;
+        float weight = inverse_base;
+        for (std::uint32_t position = 0; weight > 0x1p-24f; ++position)
+        {
+            std::uint32_t digit = index % base;
+            index /= base;
+            value += (float)permute(digit, base, hash(seed, position)) * weight;
+            weight *= inverse_base;
+        }
+        return std::min(value, one_minus_epsilon);
+    }
+};
+
+std::uint32_t reverse_bits(std::uint32_t x)
+{
+    x = ((x >> 1) & 0x55555555u) | ((x & 0x55555555u) << 1);
+    x = ((x >> 2) & 0x33333333u) | ((x & 0x33333333u) << 2);
+    x = ((x >> 4) & 0x0f0f0f0fu) | ((x & 0x0f0f0f0fu) << 4);
+    x = ((x >> 8) & 0x00ff00ffu) | ((x & 0x00ff00ffu) << 8);
+    return (x >> 16) | (x << 16);
+}
+
+// Laine and Karras: every step only lets lower bits change higher ones, so on the reversed bits
+// it is a nested uniform (Owen) scramble
+std::uint32_t nested_uniform_scramble(std::uint32_t x, std::uint32_t seed)
+{
+    x = reverse_bits(x);
+    x += seed;
+    x ^= x * 0x6c50b47cu;
+    x ^= x * 0xb82f1e52u;
+    x ^= x * 0xc7afe638u;
+    x ^= x * 0x8d22f6e6u;
+    return reverse_bits(x);
+}
+
+// Generator matrices of the first four Sobol dimensions, column k is what bit k of the index
+// flips. Dimension 0 is the van der Corput sequence, the others come from the primitive
+// polynomials and initial direction numbers of Joe and Kuo.
+const std::array<std::array<std::uint32_t, 32>, 4>& sobol_matrices()
+{
+    static const auto matrices = []
+    {
+        struct polynomial
+        {
+            std::uint32_t degree;
+            std::uint32_t coefficients;
+            std::array<std::uint32_t, 3> initial;
+        };
+        constexpr std::array<polynomial, 3> polynomials = {{
+            {1, 0, {1, 0, 0}},
+            {2, 1, {1, 3, 0}},
+            {3, 1, {1, 3, 1}},
+        }};
+
+        std::array<std::array<std::uint32_t, 32>, 4> v{};
+        for (std::uint32_t k = 0; k < 32; ++k)
+            v[0][k] = 1u << (31 - k);
+
+        for (std::size_t d = 1; d < 4; ++d)
+        {
+            const polynomial& p = polynomials[d - 1];
+            for (std::uint32_t k = 0; k < 32; ++k)
+            {
+                if (k < p.degree)
+                {
+                    v[d][k] = p.initial[k] << (31 - k);
+                    continue;
+                }
+                v[d][k] = v[d][k - p.degree] ^ (v[d][k - p.degree] >> p.degree);
+                for (std::uint32_t i = 1; i < p.degree; ++i)
+                    if ((p.coefficients >> (p.degree - 1 - i)) & 1)
+                        v[d][k] ^= v[d][k - i];
+            }
+        }
+        return v;
+    }();
+    return matrices;
+}
+
+// Burley's shuffled and scrambled 4D Sobol points: the index is scrambled too, which shuffles
+// the points of every power of two prefix without breaking its stratification, so dimensions
+// further along are padded with sets that aren't correlated to the first ones
+class sobol_sampler final : public sampler
+{
+public:
+    [[nodiscard]] float get(std::uint32_t pixel, std::uint32_t index,
+                            std::uint32_t dimension) const override
+    {
+        const auto& matrix = sobol_matrices()[dimension % 4];
+        std::uint32_t seed = hash(pixel, dimension / 4);
+
+        std::uint32_t shuffled = nested_uniform_scramble(index, seed);
+        std::uint32_t x = 0;
+        for (std::uint32_t k = 0; shuffled; ++k, shuffled >>= 1)
+            if (shuffled & 1)
+                x ^= matrix[k];
+
+        return to_unit(nested_uniform_scramble(x, hash(seed, dimension % 4)));
+    }
+};
+
+} // namespace
+
+std::unique_ptr<sampler> make_sampler(sampler_type type, int samples_per_pixel)
+{
+    switch (type)
+    {
+        case sampler_type::random:
+            return std::make_unique<random_sampler>();
+        case sampler_type::stratified:
+            return std::make_unique<stratified_sampler>(samples_per_pixel);
+        case sampler_type::halton:
+            return std::make_unique<halton_sampler>();
+        case sampler_type::sobol:
+            return std::make_unique<sobol_sampler>();
+    }
+    return nullptr;
+}
@@ -0,0 +1,93 @@
+// Ray tracing with a cone tree
+// Copyright © 2022 otreblan
+//
+// cone-tree is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// cone-tree is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with cone-tree.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string_view>
+
+// Where the random numbers of a path come from. Every camera sample of a pixel is a point in a
+// high dimensional unit cube: the position in the pixel takes dimensions 0 and 1 and bounce b
+// takes the four starting at 4 * (b + 1), three for the material and the last one for Russian
+// roulette. Keeping a dimension for the same decision in every path is what lets the
+// low discrepancy samplers spread the samples of a pixel evenly along each of them.
+//
+// random:     independent random_float() calls, what the renderer has always done.
+// stratified: dimension by dimension, the samples of a pixel go to different strata out of
+//             samples_per_pixel, shuffled independently for every pixel and dimension.
+// halton:     the radical inverse of the sample index in the dimension's own prime base, with
+//             the digits permuted per pixel and dimension.
+// sobol:      Owen scrambled 4D Sobol points, a fresh scrambled and shuffled set for every
+//             pixel and four dimensions.
+enum class sampler_type : std::uint8_t
+{
+    random,
+    stratified,
+    halton,
+    sobol,
+};
+
+sampler_type parse_sampler_type(std::string_view name);
+
+// Sample values as a function of the pixel, the sample index inside the pixel and the dimension.
+// Only random keeps state, the thread's random generator, so one sampler serves every thread.
+class sampler
+{
+public:
+    virtual ~sampler() = default;
+
+    // In [0, 1)
+    [[nodiscard]] virtual float get(std::uint32_t pixel, std::uint32_t index,
+                                    std::uint32_t dimension) const = 0;
+};
+
+// samples_per_pixel is what stratified splits every dimension into, further samples start
+// another round of strata
+std::unique_ptr<sampler> make_sampler(sampler_type type, int samples_per_pixel);
+
+// The dimensions of one camera sample, handed out in order
+class sample_stream
+{
+public:
+    static constexpr std::uint32_t dimensions_per_bounce = 4;
+
+    sample_stream(const sampler& s, std::uint32_t pixel, std::uint32_t index)
+        : s(&s), pixel(pixel), index(index)
+    {}
+
+    float next() { return s->get(pixel, index, dimension++); }
+
+    // Moves to the dimensions of a bounce, depth 0 is the camera ray's hit
+    void start_bounce(int depth)
+    {
+        bounce = dimensions_per_bounce * (std::uint32_t)(depth + 1);
+        dimension = bounce;
+    }
+
+    [[nodiscard]] float roulette() const
+    {
+        return s->get(pixel, index, bounce + dimensions_per_bounce - 1);
+    }
+
+private:
+    const sampler* s;
+    std::uint32_t pixel;
+    std::uint32_t index;
+    std::uint32_t dimension = 0;
+    std::uint32_t bounce = 0;
+};
@@ -0,0 +1,28 @@
+// Ray tracing with a cone tree
+// Copyright © 2022 otreblan
+//
+// cone-tree is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// cone-tree is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with cone-tree.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#pragma once
+
+// Constants of the surface area heuristic used by the bvh and kd6 builders. Only the ratio of the
+// two costs matters for the splits they pick, the defaults are the ones kd6 always used.
+struct sah_params
+{
+    float traverse = 1.0f;     // Cost of visiting an inner node
+    float intersect = 1.5f;    // Cost of testing one primitive
+    float empty_bonus = 0.8f;  // kd6: discount for splits that cut off empty space
+    int leaf_size = 0;         // Nodes with this many primitives or fewer are never split
+};
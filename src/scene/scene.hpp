@@ -1,13 +1,65 @@
-#pragma once
-
-#include "../object/hittable.hpp"
-#include "../rtx/ray.hpp"
-
-struct scene
-{
-    virtual bool hit(const ray& ray, float min_time, float max_time, hit_record& hit) const = 0;
-    virtual void add(std::unique_ptr<hittable>&& object) = 0;
-    virtual void clear() = 0;
-    virtual void freeze() = 0;
-    virtual ~scene() = default;
-};
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+
+#include "../layout.hpp"
+#include "../material/material.hpp"
+#include "../object/hittable.hpp"
+#include "../rtx/ray.hpp"
+#include "../sah.hpp"
+#include "../stats.hpp"
+
+// Build tuning given to make_scene(), every backend ignores what doesn't apply to it
+struct scene_options
+{
+    int treelet_rounds = 0; // bvh and qbvh: treelet restructuring passes after the build
+    node_layout layout = node_layout::build; // bvh, kd6 and split: order of the nodes
+    sah_params sah;                          // bvh, qbvh, kd6 and split: build cost model
+    bool lazy = false; // bvh: split nodes when rays first reach them, no treelets or layout then
+    std::size_t cluster_size = 1024;        // ooc: primitives per cluster on disk
+    std::size_t memory_budget = 256 << 20;  // ooc: bytes of clusters kept mapped at once
+    std::string cluster_dir;                // ooc: directory of its files, empty for the temporary one
+};
+
+struct scene
+{
+    virtual bool hit(const ray& ray, float min_time, float max_time, hit_record& hit) const = 0;
+    virtual void add(std::unique_ptr<hittable>&& object) = 0;
+    virtual void clear() = 0;
+    virtual void freeze() = 0;
+    virtual build_stats stats() const = 0;
+    virtual ~scene() = default;
+
+    // Closest hits of a batch of rays, found[k] tells if the ray k hit anything. Backends that do
+    // better when they see every ray at once override it.
+    virtual void hit_batch(const glm::vec3* origins, const glm::vec3* directions, std::size_t count,
+                           float min_time, float max_time, hit_record* hits,
+                           std::uint8_t* found) const
+    {
+        for (std::size_t k = 0; k < count; ++k)
+            found[k] = hit(ray(origins[k], directions[k]), min_time, max_time, hits[k]);
+    }
+
+    // Edits after freeze(). Objects are numbered in the order they were added, inserted ones after
+    // them, and a removed number is never reused. update() puts another object in place of one,
+    // with the same number, which is how objects move from one frame to the next. Backends that
+    // can only rebuild don't have them.
+    virtual std::size_t insert(std::unique_ptr<hittable>&&)
+    {
+        throw std::runtime_error("This scene backend can't be edited after freeze()");
+    }
+    virtual void remove(std::size_t)
+    {
+        throw std::runtime_error("This scene backend can't be edited after freeze()");
+    }
+    virtual void update(std::size_t, std::unique_ptr<hittable>&&)
+    {
+        throw std::runtime_error("This scene backend can't be edited after freeze()");
+    }
+
+    // Indexed by hit_record::mat_id, shared by every backend
+    material_table materials;
+};
@@ -0,0 +1,45 @@
+// Ray tracing with a cone tree
+// Copyright © 2022 otreblan
+//
+// cone-tree is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// cone-tree is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with cone-tree.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "scene_factory.hpp"
+
+#include <stdexcept>
+#include <string>
+
+#include "scene_bvh.hpp"
+#include "scene_kd6.hpp"
+#include "scene_list.hpp"
+#include "scene_ooc.hpp"
+#include "scene_qbvh.hpp"
+#include "scene_split.hpp"
+
+std::unique_ptr<scene> make_scene(std::string_view backend, const scene_options& options)
+{
+    if (backend == "list")
+        return std::make_unique<scene_list>();
+    else if (backend == "bvh")
+        return std::make_unique<scene_bvh>(options);
+    else if (backend == "qbvh")
+        return std::make_unique<scene_qbvh>(options);
+    else if (backend == "kd6")
+        return std::make_unique<scene_kd6>(options);
+    else if (backend == "ooc")
+        return std::make_unique<scene_ooc>(options);
+    else if (backend == "split")
+        return std::make_unique<scene_split>(options);
+
+    throw std::runtime_error("Unknown scene backend: \"" + std::string(backend) + "\"");
+}
@@ -2,12 +2,19 @@
 #include "../kd/kd6.hpp"
 #include "scene.hpp"
 
-class scene_kd6 : public scene
+class scene_kd6 final : public scene
 {
     KDTree tree;
+    scene_options options;
 public:
-    bool hit(const ray& ray, float min_time, float max_time, hit_record& hit) const override;
+    explicit scene_kd6(const scene_options& options = {}) : options(options) {}
+
+    bool hit(const ray& ray, float min_time, float max_time, hit_record& hit) const override
+    {
+        return tree.hit(ray, min_time, max_time, hit);
+    }
     void add(std::unique_ptr<hittable>&& object) override;
     void clear() override;
     void freeze() override;
+    build_stats stats() const override;
 };
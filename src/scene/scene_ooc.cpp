@@ -0,0 +1,186 @@
+// Ray tracing with a cone tree
+// Copyright © 2022 otreblan
+//
+// cone-tree is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// cone-tree is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with cone-tree.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "scene_ooc.hpp"
+
+#include <algorithm>
+
+// Calls visit(cluster, entry) for every cluster whose bounds the ray enters before t_max, nearest
+// first. visit may shrink t_max, clusters entered after it are skipped then.
+template <class Visit>
+static void for_each_cluster(const std::vector<BVHNode>& top, const ray& r, float t_min,
+                             float& t_max, Visit&& visit)
+{
+    if (top.empty())
+        return;
+
+    struct entry
+    {
+        const BVHNode* node;
+        float dist;
+    };
+    // The top tree is balanced
+    entry stack[64];
+    int stackPtr = 0;
+
+    TRAVERSAL_STATS(stats);
+
+    const BVHNode* node = &top[0];
+    float dist = node->aabb.intersection_time(r, t_min, t_max).first;
+    while (true)
+    {
+        if (dist < t_max)
+            STATS_ADD(stats, nodes, 1);
+        if (dist < t_max && node->isLeaf())
+        {
+            visit(node->leftFirst, dist);
+        }
+        else if (dist < t_max)
+        {
+            const BVHNode* child1 = &top[node->leftFirst];
+            const BVHNode* child2 = &top[node->leftFirst + 1];
+            float dist1 = child1->aabb.intersection_time(r, t_min, t_max).first;
+            float dist2 = child2->aabb.intersection_time(r, t_min, t_max).first;
+            if (dist1 > dist2)
+            {
+                std::swap(dist1, dist2);
+                std::swap(child1, child2);
+            }
+            if (dist1 != 1e30f)
+            {
+                if (dist2 != 1e30f)
+                    stack[stackPtr++] = {child2, dist2};
+                node = child1;
+                dist = dist1;
+                continue;
+            }
+        }
+        if (stackPtr == 0)
+            break;
+        --stackPtr;
+        node = stack[stackPtr].node;
+        dist = stack[stackPtr].dist;
+    }
+}
+
+bool scene_ooc::hit(const ray& r, float t_min, float t_max, hit_record& rec) const
+{
+    if (!cache)
+        return false;
+
+    TRAVERSAL_STATS(stats);
+    STATS_ADD(stats, rays, 1);
+
+    bool found = false;
+    for_each_cluster(clusters.top(), r, t_min, t_max,
+                     [&](int cluster, float)
+                     {
+                         cluster_view view = cache->acquire(cluster);
+                         found |= view.hit(r, t_min, t_max, rec);
+                         cache->release(cluster);
+                     });
+    return found;
+}
+
+void scene_ooc::hit_batch(const glm::vec3* origins, const glm::vec3* directions,
+                          std::size_t count, float min_time, float max_time, hit_record* hits,
+                          std::uint8_t* found) const
+{
+    std::fill(found, found + count, 0);
+    if (!cache)
+        return;
+
+    // Rays that reached a cluster that wasn't mapped, and where they entered it
+    struct waiting
+    {
+        int cluster;
+        std::uint32_t ray;
+        float entry;
+    };
+    std::vector<waiting> queue;
+    std::vector<float> closest(count, max_time);
+
+    TRAVERSAL_STATS(stats);
+    STATS_ADD(stats, rays, count);
+
+    for (std::size_t k = 0; k < count; ++k)
+    {
+        const ray r(origins[k], directions[k]);
+        for_each_cluster(clusters.top(), r, min_time, closest[k],
+                         [&](int cluster, float entry)
+                         {
+                             if (auto view = cache->try_acquire(cluster))
+                             {
+                                 found[k] |= view->hit(r, min_time, closest[k], hits[k]);
+                                 cache->release(cluster);
+                             }
+                             else
+                             {
+                                 queue.push_back({cluster, (std::uint32_t)k, entry});
+                             }
+                         });
+    }
+
+    // One mapping per missing cluster for all of its rays, the next one is read meanwhile
+    std::sort(queue.begin(), queue.end(), [](const waiting& a, const waiting& b)
+              { return a.cluster != b.cluster ? a.cluster < b.cluster : a.ray < b.ray; });
+    for (std::size_t first = 0; first < queue.size();)
+    {
+        const int cluster = queue[first].cluster;
+        std::size_t last = first;
+        while (last < queue.size() && queue[last].cluster == cluster)
+            last++;
+
+        cluster_view view = cache->acquire(cluster);
+        if (last < queue.size())
+            cache->prefetch(queue[last].cluster);
+        for (; first < last; first++)
+        {
+            const waiting& w = queue[first];
+            // The ray may have hit something closer in the meantime
+            if (w.entry < closest[w.ray])
+            {
+                found[w.ray] |= view.hit(ray(origins[w.ray], directions[w.ray]), min_time,
+                                         closest[w.ray], hits[w.ray]);
+            }
+        }
+        cache->release(cluster);
+    }
+}
+
+void scene_ooc::add(std::unique_ptr<hittable>&& object)
+{
+    clusters.add(packed_primitive::pack(*object));
+}
+
+void scene_ooc::freeze()
+{
+    cache.reset();
+    clusters.build(options.cluster_size, options.sah, options.treelet_rounds, options.layout);
+    cache = std::make_unique<cluster_cache>(clusters.fd(), clusters.clusters(),
+                                            options.memory_budget);
+}
+
+void scene_ooc::clear()
+{
+    cache.reset();
+    clusters.clear();
+}
+
+build_stats scene_ooc::stats() const { return clusters.stats(); }
+
+cache_stats scene_ooc::paging() const { return cache ? cache->stats() : cache_stats{}; }
@@ -0,0 +1,57 @@
+// Ray tracing with a cone tree
+// Copyright © 2022 otreblan
+//
+// cone-tree is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// cone-tree is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with cone-tree.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#pragma once
+
+#include <memory>
+
+#include "../ooc/cluster_cache.hpp"
+#include "../ooc/cluster_file.hpp"
+#include "scene.hpp"
+
+// Out of core: primitives go to disk as they are added and freeze() writes them as clusters,
+// small BVHs over nearby primitives, under a top level tree that is the only part kept in memory.
+// Clusters are mapped when rays reach them, within options.memory_budget. hit_batch() tests the
+// clusters already mapped first and queues the rays that need the others, which are then mapped
+// one at a time for all the rays waiting on them.
+class scene_ooc final : public scene
+{
+public:
+    explicit scene_ooc(const scene_options& options = {})
+        : options(options), clusters(options.cluster_dir)
+    {
+    }
+
+    bool hit(const ray& r, float t_min, float t_max, hit_record& rec) const override;
+    void hit_batch(const glm::vec3* origins, const glm::vec3* directions, std::size_t count,
+                   float min_time, float max_time, hit_record* hits,
+                   std::uint8_t* found) const override;
+    void add(std::unique_ptr<hittable>&& object) override;
+    void freeze() override;
+    void clear() override;
+    build_stats stats() const override;
+
+    // What the clusters cost in mapping and reading so far
+    [[nodiscard]] cache_stats paging() const;
+
+    ~scene_ooc() override = default;
+
+private:
+    scene_options options;
+    cluster_file clusters;
+    std::unique_ptr<cluster_cache> cache; // Only once frozen
+};
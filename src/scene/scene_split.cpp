@@ -0,0 +1,60 @@
+// Ray tracing with a cone tree
+// Copyright © 2022 otreblan
+//
+// cone-tree is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// cone-tree is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with cone-tree.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "scene_split.hpp"
+
+#include <stdexcept>
+#include <string>
+
+void scene_split::add(std::unique_ptr<hittable>&& object) { static_tree.add(std::move(object)); }
+
+void scene_split::freeze()
+{
+    for (auto& object : dynamic_tree.objects)
+        if (object)
+            static_tree.add(std::move(object));
+    dynamic_tree.objects.clear();
+    dynamic_tree.clear();
+    static_tree.build(options.layout, options.sah);
+}
+
+void scene_split::clear()
+{
+    static_tree.clear();
+    dynamic_tree.objects.clear();
+    dynamic_tree.clear();
+}
+
+build_stats scene_split::stats() const { return static_tree.stats(); }
+
+std::size_t scene_split::insert(std::unique_ptr<hittable>&& object)
+{
+    return static_tree.objects.size() + dynamic_tree.insert(std::move(object));
+}
+
+void scene_split::remove(std::size_t id)
+{
+    if (id < static_tree.objects.size())
+        throw std::runtime_error("Static object " + std::to_string(id) + " can't be removed");
+    dynamic_tree.remove((int)(id - static_tree.objects.size()));
+}
+
+void scene_split::update(std::size_t id, std::unique_ptr<hittable>&& object)
+{
+    if (id < static_tree.objects.size())
+        throw std::runtime_error("Static object " + std::to_string(id) + " can't be updated");
+    dynamic_tree.update((int)(id - static_tree.objects.size()), std::move(object));
+}
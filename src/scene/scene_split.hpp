@@ -0,0 +1,59 @@
+// Ray tracing with a cone tree
+// Copyright © 2022 otreblan
+//
+// cone-tree is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// cone-tree is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with cone-tree.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <memory>
+
+#include "../bvh/bvh.hpp"
+#include "../kd/kd6.hpp"
+#include "../object/hittable.hpp"
+#include "scene.hpp"
+
+// Objects added before freeze() are static and go to a kd6 tree built with the SAH, objects
+// inserted after it go to a BVH of their own that is edited in place. An edit only walks the
+// dynamic BVH, so its cost depends on how many objects move and not on the rest of the scene, and
+// the static tree keeps the quality of its build. A moving object is update()d every frame: it
+// keeps its number and leaf, and only the boxes above it are refit.
+class scene_split final : public scene
+{
+public:
+    explicit scene_split(const scene_options& options = {}) : options(options) {}
+
+    bool hit(const ray& r, float t_min, float t_max, hit_record& rec) const override
+    {
+        bool found = static_tree.hit(r, t_min, t_max, rec);
+        // Dynamic objects only matter in front of the closest static hit
+        return dynamic_tree.hit(r, t_min, found ? rec.t : t_max, rec) || found;
+    }
+    void add(std::unique_ptr<hittable>&& object) override;
+    // Inserted objects that are still there become static too
+    void freeze() override;
+    void clear() override;
+    // Of the static tree, the dynamic one is empty right after freeze()
+    build_stats stats() const override;
+    // Dynamic objects are numbered after the static ones, which can't be removed or updated
+    std::size_t insert(std::unique_ptr<hittable>&& object) override;
+    void remove(std::size_t id) override;
+    void update(std::size_t id, std::unique_ptr<hittable>&& object) override;
+
+    ~scene_split() override = default;
+
+private:
+    scene_options options;
+    KDTree static_tree;
+    BVH dynamic_tree;
+};
@@ -0,0 +1,48 @@
+// Ray tracing with a cone tree
+// Copyright © 2022 otreblan
+//
+// cone-tree is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// cone-tree is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with cone-tree.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#pragma once
+
+#include "scene.hpp"
+#include "scene_bvh.hpp"
+#include "scene_kd6.hpp"
+#include "scene_list.hpp"
+#include "scene_ooc.hpp"
+#include "scene_qbvh.hpp"
+#include "scene_split.hpp"
+
+// Calls f with world as its backend's own class. Backends are final, so the hit() calls f makes
+// are direct and the trees defined in headers are inlined into f, with one copy of f compiled per
+// backend. Meant to be called once, around the loops that trace rays. Backends it doesn't know
+// are passed as a scene.
+template <class F>
+decltype(auto) visit_scene(const scene& world, F&& f)
+{
+    if (const auto* backend = dynamic_cast<const scene_bvh*>(&world))
+        return f(*backend);
+    if (const auto* backend = dynamic_cast<const scene_qbvh*>(&world))
+        return f(*backend);
+    if (const auto* backend = dynamic_cast<const scene_kd6*>(&world))
+        return f(*backend);
+    if (const auto* backend = dynamic_cast<const scene_ooc*>(&world))
+        return f(*backend);
+    if (const auto* backend = dynamic_cast<const scene_split*>(&world))
+        return f(*backend);
+    if (const auto* backend = dynamic_cast<const scene_list*>(&world))
+        return f(*backend);
+    return f(world);
+}
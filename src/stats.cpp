@@ -0,0 +1,148 @@
+// Ray tracing with a cone tree
+// Copyright © 2022 otreblan
+//
+// cone-tree is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// cone-tree is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with cone-tree.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "stats.hpp"
+
+#include <algorithm>
+#include <mutex>
+
+#include <fmt/core.h>
+
+namespace
+{
+
+std::mutex registry_mutex;
+std::vector<traversal_stats*> live_stats;
+traversal_stats retired_stats;
+
+// Registers the counters of a thread so they can be summed, and keeps them after it exits
+struct stats_slot
+{
+    traversal_stats stats;
+
+    stats_slot()
+    {
+        std::lock_guard lock(registry_mutex);
+        live_stats.push_back(&stats);
+    }
+
+    ~stats_slot()
+    {
+        std::lock_guard lock(registry_mutex);
+        retired_stats += stats;
+        live_stats.erase(std::find(live_stats.begin(), live_stats.end(), &stats));
+    }
+};
+
+template <class T>
+void count(std::vector<T>& histogram, std::size_t bucket)
+{
+    if (histogram.size() <= bucket)
+        histogram.resize(bucket + 1);
+    histogram[bucket]++;
+}
+
+double per_ray(std::uint64_t counter, std::uint64_t rays)
+{
+    return rays == 0 ? 0 : (double)counter / (double)rays;
+}
+
+} // namespace
+
+traversal_stats& traversal_stats::operator+=(const traversal_stats& other) noexcept
+{
+    rays += other.rays;
+    nodes += other.nodes;
+    leaves += other.leaves;
+    primitives += other.primitives;
+    empty_leaves += other.empty_leaves;
+    return *this;
+}
+
+traversal_stats traversal_stats::operator-(const traversal_stats& other) const noexcept
+{
+    return {rays - other.rays, nodes - other.nodes, leaves - other.leaves,
+            primitives - other.primitives, empty_leaves - other.empty_leaves};
+}
+
+traversal_stats& local_traversal_stats()
+{
+    thread_local stats_slot slot;
+    return slot.stats;
+}
+
+traversal_stats collect_traversal_stats()
+{
+    std::lock_guard lock(registry_mutex);
+    traversal_stats total = retired_stats;
+    for (const auto* stats : live_stats)
+        total += *stats;
+    return total;
+}
+
+void reset_traversal_stats()
+{
+    std::lock_guard lock(registry_mutex);
+    retired_stats = {};
+    for (auto* stats : live_stats)
+        *stats = {};
+}
+
+void build_stats::add_inner(int, float area, float cost_traverse)
+{
+    nodes++;
+    sah_cost += cost_traverse * area;
+}
+
+void build_stats::add_leaf(int depth, float area, int size, float cost_intersect)
+{
+    nodes++;
+    leaves++;
+    if (size == 0)
+        empty_leaves++;
+    references += size;
+    count(leaf_depths, depth);
+    count(leaf_sizes, size);
+    sah_cost += cost_intersect * area * (float)size;
+}
+
+void print_stats(std::FILE* file, const build_stats& stats)
+{
+    fmt::print(file, "Nodes: {} ({} leaves, {} empty)\n", stats.nodes, stats.leaves,
+               stats.empty_leaves);
+    fmt::print(file, "References: {} ({} duplicated)\n", stats.references,
+               stats.references - std::min(stats.references, stats.primitives));
+    fmt::print(file, "SAH cost: {}\n", stats.sah_cost);
+
+    fmt::print(file, "Leaf depths:");
+    for (std::size_t depth = 0; depth < stats.leaf_depths.size(); ++depth)
+        if (stats.leaf_depths[depth])
+            fmt::print(file, " {}:{}", depth, stats.leaf_depths[depth]);
+
+    fmt::print(file, "\nLeaf sizes:");
+    for (std::size_t size = 0; size < stats.leaf_sizes.size(); ++size)
+        if (stats.leaf_sizes[size])
+            fmt::print(file, " {}:{}", size, stats.leaf_sizes[size]);
+    fmt::print(file, "\n");
+}
+
+void print_stats(std::FILE* file, const traversal_stats& stats)
+{
+    fmt::print(file, "Rays: {}\n", stats.rays);
+    fmt::print(file, "Per ray: {:.2f} nodes, {:.2f} leaves, {:.2f} primitives, {:.2f} empty leaves\n",
+               per_ray(stats.nodes, stats.rays), per_ray(stats.leaves, stats.rays),
+               per_ray(stats.primitives, stats.rays), per_ray(stats.empty_leaves, stats.rays));
+}
@@ -0,0 +1,72 @@
+// Ray tracing with a cone tree
+// Copyright © 2022 otreblan
+//
+// cone-tree is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// cone-tree is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with cone-tree.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+// Traversal counters are only compiled in with -DCONE_TREE_STATS=ON, otherwise the macros below
+// expand to nothing and the traversal loops are left untouched.
+struct traversal_stats
+{
+    std::uint64_t rays = 0;
+    std::uint64_t nodes = 0;        // Visited nodes, leaves included
+    std::uint64_t leaves = 0;       // Visited leaves
+    std::uint64_t primitives = 0;   // Primitive intersection tests
+    std::uint64_t empty_leaves = 0; // Visited leaves without primitives
+
+    traversal_stats& operator+=(const traversal_stats& other) noexcept;
+    traversal_stats operator-(const traversal_stats& other) const noexcept;
+};
+
+// Counters of the calling thread
+traversal_stats& local_traversal_stats();
+
+// Sum of every thread, only meaningful while no rays are in flight
+traversal_stats collect_traversal_stats();
+void reset_traversal_stats();
+
+#ifdef CONE_TREE_STATS
+constexpr bool traversal_stats_enabled = true;
+#define TRAVERSAL_STATS(name) traversal_stats& name = local_traversal_stats()
+#define STATS_ADD(name, counter, n) ((name).counter += (n))
+#else
+constexpr bool traversal_stats_enabled = false;
+#define TRAVERSAL_STATS(name)
+#define STATS_ADD(name, counter, n) ((void)0)
+#endif
+
+// Shape of a built acceleration structure
+struct build_stats
+{
+    int nodes = 0;
+    int leaves = 0;
+    int empty_leaves = 0;
+    std::uint64_t primitives = 0;
+    std::uint64_t references = 0;   // Primitive references in leaves, duplicates included
+    std::vector<int> leaf_depths;   // Leaves per depth
+    std::vector<int> leaf_sizes;    // Leaves per primitive count
+    float sah_cost = 0;             // Expected cost of a random ray hitting the root bounds
+
+    // Every node must be added, area is its surface area relative to the root
+    void add_inner(int depth, float area, float cost_traverse);
+    void add_leaf(int depth, float area, int size, float cost_intersect);
+};
+
+void print_stats(std::FILE* file, const build_stats& stats);
+void print_stats(std::FILE* file, const traversal_stats& stats);
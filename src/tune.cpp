@@ -0,0 +1,194 @@
+// Ray tracing with a cone tree
+// Copyright © 2022 otreblan
+//
+// cone-tree is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// cone-tree is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with cone-tree.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "tune.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+#include <fmt/core.h>
+#include <glm/geometric.hpp>
+
+#include "scene/visit_scene.hpp"
+#include "timer.hpp"
+
+std::string tune_path(std::string_view scene_path) { return std::string(scene_path) + ".tune"; }
+
+static bool parse_tune_line(const std::string& line, std::string& backend, sah_params& sah)
+{
+    std::istringstream iss(line);
+    if (!(iss >> backend) || backend[0] == '#')
+        return false;
+    if (!(iss >> sah.traverse >> sah.intersect >> sah.empty_bonus >> sah.leaf_size))
+        throw std::runtime_error("Bad tune line: \"" + line + "\"");
+    return true;
+}
+
+bool read_tune(const std::string& path, std::string_view backend, sah_params& sah)
+{
+    std::ifstream file(path);
+    std::string line;
+    while (std::getline(file, line))
+    {
+        std::string name;
+        sah_params read;
+        if (parse_tune_line(line, name, read) && name == backend)
+        {
+            sah = read;
+            return true;
+        }
+    }
+    return false;
+}
+
+void write_tune(const std::string& path, std::string_view backend, const sah_params& sah)
+{
+    std::vector<std::string> lines;
+    {
+        std::ifstream file(path);
+        std::string line;
+        while (std::getline(file, line))
+        {
+            std::string name;
+            sah_params read;
+            if (parse_tune_line(line, name, read) && name != backend)
+                lines.push_back(line);
+        }
+    }
+    lines.push_back(fmt::format("{} {} {} {} {}", backend, sah.traverse, sah.intersect,
+                                sah.empty_bonus, sah.leaf_size));
+
+    std::ofstream file(path);
+    if (!file)
+        throw std::runtime_error("Failed to open " + path);
+    file << "# backend traverse intersect empty_bonus leaf_size\n";
+    for (const auto& line : lines)
+        file << line << '\n';
+}
+
+// Camera rays over a small grid and one diffuse bounce off every hit, like the benchmarks
+static std::vector<ray> sample_rays(const scene& world, const camera& cam,
+                                    const tune_settings& settings)
+{
+    std::mt19937 gen(settings.seed);
+    std::uniform_real_distribution<float> jitter(0.f, 1.f);
+    std::normal_distribution<float> normal(0.f, 1.f);
+
+    const int width = settings.width;
+    const int height = std::max(1, width * 9 / 16);
+    std::vector<ray> rays;
+    for (int j = 0; j < height; ++j)
+        for (int i = 0; i < width; ++i)
+            rays.push_back(cam.get_ray((i + jitter(gen)) / width, (j + jitter(gen)) / height));
+
+    const std::size_t primary = rays.size();
+    for (std::size_t i = 0; i < primary; ++i)
+    {
+        hit_record rec;
+        if (!world.hit(rays[i], 0.001f, HUGE_VALF, rec))
+            continue;
+        glm::vec3 dir = glm::vec3(normal(gen), normal(gen), normal(gen));
+        rays.emplace_back(rec.p, rec.normal + glm::normalize(dir));
+    }
+    return rays;
+}
+
+template <class World>
+static double best_time(const World& world, const std::vector<ray>& rays, int repeats)
+{
+    double best = HUGE_VAL;
+    Timer timer;
+    for (int run = 0; run < repeats; ++run)
+    {
+        timer.reset();
+        for (const auto& r : rays)
+        {
+            hit_record rec;
+            world.hit(r, 0.001f, HUGE_VALF, rec);
+        }
+        best = std::min(best, timer.elapsed());
+    }
+    return best;
+}
+
+// Through the same non-virtual calls renders make
+static double trace_time(const scene& world, const std::vector<ray>& rays, int repeats)
+{
+    return visit_scene(world,
+                       [&](const auto& backend) { return best_time(backend, rays, repeats); });
+}
+
+tune_result autotune(std::string_view backend, const scene_options& options,
+                     const scene_builder& build, const camera& cam, const tune_settings& settings)
+{
+    if (backend != "bvh" && backend != "qbvh" && backend != "kd6" && backend != "split")
+        throw std::runtime_error("Only bvh, qbvh, kd6 and split can be tuned");
+
+    tune_result result;
+    scene_options candidate = options;
+    std::vector<ray> rays;
+
+    auto measure = [&](const sah_params& sah)
+    {
+        candidate.sah = sah;
+        Timer timer;
+        auto world = build(candidate);
+        double build_s = timer.elapsed();
+        if (rays.empty())
+            rays = sample_rays(*world, cam, settings);
+        double trace_s = trace_time(*world, rays, settings.repeats);
+        result.builds++;
+        fmt::print(stderr,
+                   "Tune: traverse {} intersect {} empty_bonus {} leaf_size {}: build {:.3f}s, "
+                   "trace {:.2f}ms\n",
+                   sah.traverse, sah.intersect, sah.empty_bonus, sah.leaf_size, build_s,
+                   1000 * trace_s);
+        return trace_s;
+    };
+
+    result.best = options.sah;
+    result.best_s = result.initial_s = measure(result.best);
+
+    // One pass of coordinate descent, a value has to beat the best by 3% to not chase noise
+    auto descend = [&](auto field, std::initializer_list<double> values, bool scale)
+    {
+        const auto start = result.best.*field;
+        for (double value : values)
+        {
+            sah_params sah = result.best;
+            sah.*field = scale ? (decltype(start))(start * value) : (decltype(start))value;
+            if (sah.*field == result.best.*field)
+                continue;
+            double t = measure(sah);
+            if (t < result.best_s * 0.97)
+                result.best = sah, result.best_s = t;
+        }
+    };
+
+    descend(&sah_params::traverse, {0.25, 0.5, 2, 4}, true);
+    // The static tree of split is a kd6 too
+    if (backend == "kd6" || backend == "split")
+        descend(&sah_params::empty_bonus, {0.6, 0.7, 0.8, 0.9, 1}, false);
+    descend(&sah_params::leaf_size, {0, 1, 2, 4, 8}, false);
+
+    return result;
+}
@@ -0,0 +1,64 @@
+// Ray tracing with a cone tree
+// Copyright © 2022 otreblan
+//
+// cone-tree is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// cone-tree is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with cone-tree.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include "rtx/camera.hpp"
+#include "scene/scene.hpp"
+
+// The best build constants of a scene are saved next to it, in <scene>.tune, one line per backend:
+//
+//     <backend> <traverse> <intersect> <empty_bonus> <leaf_size>
+//
+// Lines starting with # are comments.
+std::string tune_path(std::string_view scene_path);
+
+// Leaves sah untouched and returns false when the file or the backend line is missing
+bool read_tune(const std::string& path, std::string_view backend, sah_params& sah);
+
+// Replaces the line of backend, the other backends keep theirs
+void write_tune(const std::string& path, std::string_view backend, const sah_params& sah);
+
+struct tune_settings
+{
+    int width = 160;  // Primary rays per row of the sample, 16:9
+    int repeats = 5;  // Every set is traced this many times and the fastest run counts
+    unsigned seed = 1;
+};
+
+struct tune_result
+{
+    sah_params best;
+    double best_s = 0;    // Trace time of the sample with best
+    double initial_s = 0; // and with the constants it started from
+    int builds = 0;
+};
+
+// Returns a frozen scene built with the given options
+using scene_builder = std::function<std::unique_ptr<scene>(const scene_options&)>;
+
+// Builds the scene with one constant changed at a time, starting from options.sah, and keeps the
+// value that traces a fixed sample of camera rays and their diffuse bounces the fastest. The
+// ratio of the two costs is what matters, so only the traversal cost moves.
+tune_result autotune(std::string_view backend, const scene_options& options,
+                     const scene_builder& build, const camera& cam,
+                     const tune_settings& settings = {});